@@ -0,0 +1,492 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pixman.h>
+#include "atlas.h"
+
+/* Open addressing; the oldest entries are dropped before it fills up. */
+#define CACHE_SIZE 4096
+#define CACHE_MAX_LOAD (CACHE_SIZE * 3 / 4)
+/* Glyphs larger than this in either direction are not drawn. */
+#define MAX_GLYPH_SIZE 256
+#define GLYPH_GAP 1
+/* Compaction keeps the glyphs drawn within this many frames. */
+#define KEEP_FRAMES 256
+
+/* A cache slot is free while its font is NULL. */
+struct entry {
+    struct atlas_glyph glyph;
+    uint32_t last_used;
+};
+
+/*
+ * Skyline packer: the top edge of a page's used area as segments from left
+ * to right. A glyph goes where its bottom edge ends up lowest.
+ */
+struct skyline_node {
+    int16_t x, y, width;
+};
+
+struct page {
+    GLuint texture;
+    struct skyline_node nodes[ATLAS_SIZE];
+    int node_count;
+    int glyph_count;
+    uint32_t last_used;
+};
+
+static struct page pages[ATLAS_MAX_PAGES];
+static struct entry cache[CACHE_SIZE];
+static int cache_count;
+/*
+ * Only the drawing thread writes these, but atlas_get_stats() may read
+ * them on another; stores and loads are relaxed atomics.
+ */
+static struct atlas_stats stats;
+#define STAT_ADD(field, n) __atomic_store_n(&stats.field, stats.field + (n), __ATOMIC_RELAXED)
+/* Starts at 1, so that a last_used of 0 is older than every frame. */
+static uint32_t frame = 1;
+
+/* Scratch space for rebuilding the cache after an eviction or compaction. */
+static struct entry survivors[CACHE_SIZE];
+/* Set while compaction repacks from survivors, which evicting would overwrite. */
+static bool compacting;
+
+static uint8_t staging[MAX_GLYPH_SIZE * MAX_GLYPH_SIZE * 4];
+
+static void clear_page(struct page *page) {
+    page->nodes[0] = (struct skyline_node){0, 0, ATLAS_SIZE};
+    page->node_count = 1;
+    page->glyph_count = 0;
+}
+
+static void allocate_page(struct page *page) {
+    glGenTextures(1, &page->texture);
+    glBindTexture(GL_TEXTURE_2D, page->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_SIZE, ATLAS_SIZE, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    clear_page(page);
+    STAT_ADD(pages, 1);
+}
+
+static void release_page(struct page *page) {
+    glDeleteTextures(1, &page->texture);
+    page->texture = 0;
+    STAT_ADD(pages, -1);
+}
+
+void atlas_init(void) {
+    allocate_page(&pages[0]);
+    atlas_reset();
+    __atomic_store_n(&stats.resets, 0, __ATOMIC_RELAXED);
+}
+
+void atlas_finish(void) {
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].texture) {
+            release_page(&pages[i]);
+        }
+    }
+}
+
+GLuint atlas_texture(int page) {
+    return pages[page].texture;
+}
+
+void atlas_begin_frame(void) {
+    frame++;
+}
+
+/* Pages keep their textures; only their contents are forgotten. */
+void atlas_reset(void) {
+    memset(cache, 0, sizeof(cache));
+    cache_count = 0;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        clear_page(&pages[i]);
+    }
+    STAT_ADD(resets, 1);
+}
+
+void atlas_get_stats(struct atlas_stats *out) {
+    out->hits = __atomic_load_n(&stats.hits, __ATOMIC_RELAXED);
+    out->misses = __atomic_load_n(&stats.misses, __ATOMIC_RELAXED);
+    out->uploaded_pixels = __atomic_load_n(&stats.uploaded_pixels, __ATOMIC_RELAXED);
+    out->resets = __atomic_load_n(&stats.resets, __ATOMIC_RELAXED);
+    out->evictions = __atomic_load_n(&stats.evictions, __ATOMIC_RELAXED);
+    out->compactions = __atomic_load_n(&stats.compactions, __ATOMIC_RELAXED);
+    out->pages = __atomic_load_n(&stats.pages, __ATOMIC_RELAXED);
+}
+
+static uint32_t hash_key(struct fcft_font *font, uint32_t cp, enum fcft_subpixel subpixel) {
+    uint64_t h = (uintptr_t)font * 0x9e3779b97f4a7c15ull;
+    h ^= cp * 0xff51afd7ed558ccdull;
+    h ^= (uint64_t)subpixel << 59;
+    return (uint32_t)(h >> 32) & (CACHE_SIZE - 1);
+}
+
+static struct entry *free_slot(struct fcft_font *font, uint32_t cp,
+                               enum fcft_subpixel subpixel) {
+    uint32_t index = hash_key(font, cp, subpixel);
+    while (cache[index].glyph.font) {
+        index = (index + 1) & (CACHE_SIZE - 1);
+    }
+    return &cache[index];
+}
+
+/* Fills survivors with the entries that are kept and rehashes them. */
+static int rebuild_cache(bool (*keep)(const struct entry *entry, void *data), void *data) {
+    int count = 0;
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].glyph.font && keep(&cache[i], data)) {
+            survivors[count++] = cache[i];
+        }
+    }
+    memset(cache, 0, sizeof(cache));
+    cache_count = count;
+    return count;
+}
+
+static void reinsert_survivors(int count) {
+    for (int i = 0; i < count; i++) {
+        const struct atlas_glyph *glyph = &survivors[i].glyph;
+        *free_slot(glyph->font, glyph->cp, glyph->subpixel) = survivors[i];
+    }
+}
+
+static bool not_on_page(const struct entry *entry, void *data) {
+    const struct page *page = data;
+    return entry->glyph.width == 0 || &pages[entry->glyph.page] != page;
+}
+
+/* Returns NULL when the current frame draws from every page. */
+static struct page *least_recently_used(void) {
+    struct page *lru = NULL;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        struct page *page = &pages[i];
+        if (page->texture && page->last_used != frame &&
+            (lru == NULL || frame - page->last_used > frame - lru->last_used)) {
+            lru = page;
+        }
+    }
+    return lru;
+}
+
+static bool any_entry(const struct entry *entry, void *data) {
+    return true;
+}
+
+/* Most recently used first. */
+static int compare_recency(const void *a, const void *b) {
+    uint32_t x = frame - ((const struct entry *)a)->last_used;
+    uint32_t y = frame - ((const struct entry *)b)->last_used;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Makes room in the table by keeping only the most recently used half of
+ * it. The pixels of the dropped glyphs stay behind as dead space until the
+ * page is evicted or compacted.
+ */
+static bool evict_entries(void) {
+    int count = rebuild_cache(any_entry, NULL);
+    qsort(survivors, count, sizeof(survivors[0]), compare_recency);
+    int keep = CACHE_MAX_LOAD / 2;
+    while (keep < count && survivors[keep].last_used == frame) {
+        keep++;
+    }
+    cache_count = keep < count ? keep : count;
+    reinsert_survivors(cache_count);
+    if (keep >= count) {
+        return false;
+    }
+    STAT_ADD(evictions, 1);
+    return true;
+}
+
+/* Empties the least recently used page and returns it. */
+static struct page *evict(void) {
+    struct page *page = least_recently_used();
+    if (page == NULL) {
+        return NULL;
+    }
+    reinsert_survivors(rebuild_cache(not_on_page, page));
+    clear_page(page);
+    STAT_ADD(evictions, 1);
+    return page;
+}
+
+static bool skyline_fits(const struct page *page, int i, int width, int height, int *y) {
+    if (page->nodes[i].x + width > ATLAS_SIZE) {
+        return false;
+    }
+    int top = 0;
+    for (int left = width; left > 0; i++) {
+        if (i == page->node_count) {
+            return false;
+        }
+        if (page->nodes[i].y > top) {
+            top = page->nodes[i].y;
+        }
+        if (top + height > ATLAS_SIZE) {
+            return false;
+        }
+        left -= page->nodes[i].width;
+    }
+    *y = top;
+    return true;
+}
+
+static bool skyline_pack(struct page *page, int width, int height, int *x, int *y) {
+    int best = -1, best_bottom = ATLAS_SIZE + 1, best_width = 0;
+    for (int i = 0; i < page->node_count; i++) {
+        int top;
+        if (skyline_fits(page, i, width, height, &top) &&
+            (top + height < best_bottom ||
+             (top + height == best_bottom && page->nodes[i].width < best_width))) {
+            best = i;
+            best_bottom = top + height;
+            best_width = page->nodes[i].width;
+        }
+    }
+    if (best < 0) {
+        return false;
+    }
+
+    struct skyline_node *nodes = page->nodes;
+    struct skyline_node node = {nodes[best].x, best_bottom, width};
+    memmove(&nodes[best + 1], &nodes[best], (page->node_count - best) * sizeof(*nodes));
+    nodes[best] = node;
+    page->node_count++;
+
+    /* Trim or drop the segments the new one now covers. */
+    int i = best + 1;
+    while (i < page->node_count && nodes[i].x < node.x + node.width) {
+        int covered = node.x + node.width - nodes[i].x;
+        if (covered < nodes[i].width) {
+            nodes[i].x += covered;
+            nodes[i].width -= covered;
+            break;
+        }
+        memmove(&nodes[i], &nodes[i + 1], (page->node_count - i - 1) * sizeof(*nodes));
+        page->node_count--;
+    }
+    /* Merge neighbours at the same height. */
+    for (i = 0; i + 1 < page->node_count; i++) {
+        if (nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+            memmove(&nodes[i + 1], &nodes[i + 2], (page->node_count - i - 2) * sizeof(*nodes));
+            page->node_count--;
+            i--;
+        }
+    }
+
+    *x = node.x;
+    *y = node.y - height;
+    return true;
+}
+
+/* Tries the allocated pages, then a new one, then evicts. */
+static struct page *place(int width, int height, int *x, int *y) {
+    width += GLYPH_GAP;
+    height += GLYPH_GAP;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].texture && skyline_pack(&pages[i], width, height, x, y)) {
+            return &pages[i];
+        }
+    }
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].texture == 0) {
+            allocate_page(&pages[i]);
+            return skyline_pack(&pages[i], width, height, x, y) ? &pages[i] : NULL;
+        }
+    }
+    if (compacting) {
+        return NULL;
+    }
+    /* An emptied page fits any glyph within MAX_GLYPH_SIZE. */
+    struct page *page = evict();
+    if (page == NULL) {
+        return NULL;
+    }
+    return skyline_pack(page, width, height, x, y) ? page : NULL;
+}
+
+/* Converts a glyph image to RGBA bytes in the layout the shader expects. */
+static enum glyph_mode convert(pixman_image_t *pix, int width, int height) {
+    pixman_format_code_t format = pixman_image_get_format(pix);
+    const uint8_t *src = (const uint8_t *)pixman_image_get_data(pix);
+    int stride = pixman_image_get_stride(pix);
+    enum glyph_mode mode;
+
+    if (format == PIXMAN_a8r8g8b8 || format == PIXMAN_x8r8g8b8) {
+        mode = pixman_image_get_component_alpha(pix) ? GLYPH_SUBPIXEL : GLYPH_COLOR;
+    } else {
+        mode = GLYPH_MASK;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const uint8_t *row = src + y * stride;
+        uint8_t *dst = staging + y * width * 4;
+        for (int x = 0; x < width; x++, dst += 4) {
+            if (format == PIXMAN_a8) {
+                dst[0] = dst[1] = dst[2] = dst[3] = row[x];
+            } else if (format == PIXMAN_a1) {
+                uint32_t word = ((const uint32_t *)row)[x / 32];
+                uint8_t a = (word >> (x % 32)) & 1 ? 0xff : 0x00;
+                dst[0] = dst[1] = dst[2] = dst[3] = a;
+            } else {
+                uint32_t argb = ((const uint32_t *)row)[x];
+                uint8_t r = argb >> 16, g = argb >> 8, b = argb;
+                uint8_t a = mode == GLYPH_SUBPIXEL ? (r > g ? (r > b ? r : b) : (g > b ? g : b))
+                                                   : argb >> 24;
+                dst[0] = r;
+                dst[1] = g;
+                dst[2] = b;
+                dst[3] = a;
+            }
+        }
+    }
+    return mode;
+}
+
+/* Rasterizes, packs and uploads a glyph that is not in the cache. */
+static struct entry *add_glyph(struct fcft_font *font, uint32_t cp,
+                               enum fcft_subpixel subpixel) {
+    if (cache_count >= CACHE_MAX_LOAD && (compacting || !evict_entries())) {
+        return NULL;
+    }
+    const struct fcft_glyph *source = fcft_rasterize_char_utf32(font, cp, subpixel);
+    if (source == NULL) {
+        return NULL;
+    }
+
+    int width = source->width, height = source->height;
+    if (width > MAX_GLYPH_SIZE || height > MAX_GLYPH_SIZE) {
+        width = height = 0;
+    }
+
+    int x = 0, y = 0;
+    struct page *page = NULL;
+    if (width > 0 && height > 0 && (page = place(width, height, &x, &y)) == NULL) {
+        return NULL;
+    }
+
+    /* Looked up only now: placing may have evicted and rehashed. */
+    struct entry *entry = free_slot(font, cp, subpixel);
+    struct atlas_glyph *glyph = &entry->glyph;
+    glyph->font = font;
+    glyph->cp = cp;
+    glyph->subpixel = subpixel;
+    glyph->x = source->x;
+    glyph->y = source->y;
+    glyph->width = width;
+    glyph->height = height;
+    glyph->advance = source->advance.x;
+    glyph->mode = GLYPH_MASK;
+    glyph->page = page ? page - pages : 0;
+    glyph->u0 = (float)x / ATLAS_SIZE;
+    glyph->v0 = (float)y / ATLAS_SIZE;
+    glyph->u1 = (float)(x + width) / ATLAS_SIZE;
+    glyph->v1 = (float)(y + height) / ATLAS_SIZE;
+    cache_count++;
+
+    if (page) {
+        page->glyph_count++;
+        glyph->mode = convert(source->pix, width, height);
+        glBindTexture(GL_TEXTURE_2D, page->texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height,
+                        GL_RGBA, GL_UNSIGNED_BYTE, staging);
+        STAT_ADD(uploaded_pixels, (uint64_t)width * height);
+    }
+    return entry;
+}
+
+static void touch(struct entry *entry) {
+    entry->last_used = frame;
+    if (entry->glyph.width > 0) {
+        pages[entry->glyph.page].last_used = frame;
+    }
+}
+
+const struct atlas_glyph *atlas_get(struct fcft_font *font, uint32_t cp,
+                                    enum fcft_subpixel subpixel) {
+    uint32_t index = hash_key(font, cp, subpixel);
+    while (cache[index].glyph.font) {
+        struct entry *entry = &cache[index];
+        if (entry->glyph.font == font && entry->glyph.cp == cp &&
+            entry->glyph.subpixel == subpixel) {
+            STAT_ADD(hits, 1);
+            touch(entry);
+            return &entry->glyph;
+        }
+        index = (index + 1) & (CACHE_SIZE - 1);
+    }
+    STAT_ADD(misses, 1);
+
+    struct entry *entry = add_glyph(font, cp, subpixel);
+    if (entry == NULL) {
+        return NULL;
+    }
+    touch(entry);
+    return &entry->glyph;
+}
+
+static bool recently_used(const struct entry *entry, void *data) {
+    return frame - entry->last_used <= KEEP_FRAMES;
+}
+
+/* Tallest first packs tightest on a skyline. */
+static int compare_height(const void *a, const void *b) {
+    return ((const struct entry *)b)->glyph.height - ((const struct entry *)a)->glyph.height;
+}
+
+/*
+ * Glyphs come back out of fcft's own cache, so repacking costs uploads but
+ * no rasterization. Repacked in another order they need not all fit again;
+ * nothing is evicted meanwhile, and those that do not fit are dropped and
+ * come back when next drawn.
+ */
+void atlas_compact(void) {
+    int stale = 0;
+    for (int i = 0; i < CACHE_SIZE; i++) {
+        if (cache[i].glyph.font && !recently_used(&cache[i], NULL)) {
+            stale++;
+        }
+    }
+    if (stale == 0) {
+        return;
+    }
+
+    int count = rebuild_cache(recently_used, NULL);
+    cache_count = 0;
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        clear_page(&pages[i]);
+    }
+    qsort(survivors, count, sizeof(survivors[0]), compare_height);
+    compacting = true;
+    for (int i = 0; i < count; i++) {
+        const struct atlas_glyph *glyph = &survivors[i].glyph;
+        struct entry *entry = add_glyph(glyph->font, glyph->cp, glyph->subpixel);
+        if (entry == NULL) {
+            break;
+        }
+        entry->last_used = survivors[i].last_used;
+        struct page *page = &pages[entry->glyph.page];
+        if (entry->glyph.width > 0 && frame - entry->last_used < frame - page->last_used) {
+            page->last_used = entry->last_used;
+        }
+    }
+    compacting = false;
+
+    /* The first page stays, so that drawing never starts from nothing. */
+    for (int i = 1; i < ATLAS_MAX_PAGES; i++) {
+        if (pages[i].texture && pages[i].glyph_count == 0) {
+            release_page(&pages[i]);
+        }
+    }
+    STAT_ADD(compactions, 1);
+}
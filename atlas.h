@@ -0,0 +1,71 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <GLES2/gl2.h>
+#include <fcft/fcft.h>
+
+/*
+ * GL glyph atlas. Glyphs are rasterized by fcft once, packed into RGBA
+ * texture pages and looked up by (font, codepoint, subpixel mode)
+ * afterwards, so redrawing text that was seen before uploads nothing.
+ *
+ * Pages are skyline-packed and allocated on demand, up to ATLAS_MAX_PAGES,
+ * which bounds GPU memory. When every page is full, the least recently
+ * used page that the current frame does not draw from is emptied; when the
+ * lookup table fills up, its least recently used half is dropped. While
+ * the bar is idle, atlas_compact() drops glyphs that have not been drawn
+ * for a while and repacks the rest, releasing pages that end up empty.
+ */
+#define ATLAS_SIZE 1024
+#define ATLAS_MAX_PAGES 4
+
+enum glyph_mode {
+    GLYPH_MASK,     /* coverage in alpha */
+    GLYPH_SUBPIXEL, /* per-channel coverage in rgb (LCD) */
+    GLYPH_COLOR,    /* premultiplied rgba (emoji) */
+};
+
+struct atlas_glyph {
+    struct fcft_font *font;
+    uint32_t cp;
+    enum fcft_subpixel subpixel;
+    float u0, v0, u1, v1;
+    int16_t x, y;
+    int16_t width, height;
+    int16_t advance;
+    uint8_t mode;
+    uint8_t page;
+};
+
+struct atlas_stats {
+    uint64_t hits, misses;
+    uint64_t uploaded_pixels;
+    uint64_t resets;
+    /* Pages emptied or table halvings to make room. */
+    uint64_t evictions;
+    uint64_t compactions;
+    int pages;
+};
+
+void atlas_init(void);
+void atlas_finish(void);
+/* 0 for pages that are not allocated. */
+GLuint atlas_texture(int page);
+/* Glyphs looked up after this belong to a new frame. */
+void atlas_begin_frame(void);
+/*
+ * Returns NULL when the glyph does not fit even after eviction, which
+ * only happens when the current frame draws from every page. The caller
+ * must flush draws that reference the atlas, call atlas_reset() and try
+ * again.
+ */
+const struct atlas_glyph *atlas_get(struct fcft_font *font, uint32_t cp,
+                                    enum fcft_subpixel subpixel);
+void atlas_reset(void);
+void atlas_compact(void);
+/* Safe to call from any thread. */
+void atlas_get_stats(struct atlas_stats *out);
+
+#endif
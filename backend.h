@@ -0,0 +1,74 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "damage.h"
+#include "scene.h"
+
+struct wl_display;
+struct wl_shm;
+struct wl_subsurface;
+struct wl_surface;
+struct wp_viewport;
+
+/* Where a child subsurface goes; parent state, applied by the parent's commit. */
+struct subsurface_position {
+    struct wl_subsurface *subsurface;
+    int32_t x, y;
+};
+
+/*
+ * A render target is one wl_surface plus whatever buffers the backend keeps
+ * for it. Backends embed this struct in their own target type. The history
+ * lets a backend repaint only what changed since a buffer was last used.
+ * A target may show just part of a scene; x and y place its top-left corner
+ * in scene coordinates.
+ *
+ * The backend sets queued child positions right before it commits, so
+ * they apply with that frame and no earlier one, even when the commit
+ * happens on another thread; present() consumes them.
+ */
+struct render_target {
+    struct wl_surface *surface;
+    /* Role objects of the surface, if any; destroyed along with it. */
+    struct wl_subsurface *subsurface;
+    struct wp_viewport *viewport;
+    int32_t x, y;
+    int32_t width, height;
+    struct damage_history history;
+    struct subsurface_position positions[SCENE_MAX_BLOCKS];
+    int position_count;
+};
+
+struct backend {
+    const char *name;
+    void (*init)(struct wl_display *display, struct wl_shm *shm);
+    struct render_target *(*create_target)(struct wl_surface *surface,
+                                           int32_t width, int32_t height);
+    void (*resize_target)(struct render_target *target, int32_t width, int32_t height);
+    /*
+     * Readies a buffer for the next frame. Returns false when none is free;
+     * the caller keeps its damage and retries after the next event.
+     */
+    bool (*acquire)(struct render_target *target);
+    /* Repaints what the damage requires from the scene and commits the surface. */
+    void (*present)(struct render_target *target, const struct scene *scene,
+                    const struct damage *damage);
+    /* Also destroys the target's wl_surface and role objects, once done with them. */
+    void (*destroy_target)(struct render_target *target);
+    void (*finish)(void);
+    /*
+     * Optional, called before init. With an interval of 0, present() no
+     * longer waits for the compositor before returning; pacing is then
+     * entirely up to the caller.
+     */
+    void (*set_swap_interval)(int interval);
+    /* Optional: drops caches that can be rebuilt, called once the bar is idle. */
+    void (*trim)(void);
+};
+
+extern const struct backend egl_backend;
+extern const struct backend shm_backend;
+
+#endif
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include "viewporter-client-protocol.h"
+#include "backend.h"
+#include "render.h"
+#include "stats.h"
+
+struct egl_target {
+    struct render_target base;
+    struct wl_egl_window *window;
+    EGLSurface surface;
+};
+
+static EGLDisplay egl_display;
+static EGLContext egl_context;
+static EGLConfig config;
+static bool render_ready;
+static EGLint swap_interval = 1;
+/* Every target shares the one context; it is rebound to whichever draws. */
+static EGLSurface current_surface = EGL_NO_SURFACE;
+
+/*
+ * Damage-based repaint and presentation are both optional and fall back to
+ * full redraws and a plain eglSwapBuffers.
+ */
+static bool has_buffer_age;
+static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_buffers_with_damage;
+
+static void check_egl_error(const char *msg) {
+    EGLint error = eglGetError();
+    if (error != EGL_SUCCESS) {
+        fprintf(stderr, "%s: EGL error 0x%x\n", msg, error);
+        exit(1);
+    }
+}
+
+static void init_egl(struct wl_display *display, struct wl_shm *shm) {
+    EGLint major, minor;
+    egl_display = eglGetDisplay((EGLNativeDisplayType)display);
+    if (egl_display == EGL_NO_DISPLAY) {
+        fprintf(stderr, "Can't create egl display\n");
+        exit(1);
+    }
+
+    if (!eglInitialize(egl_display, &major, &minor)) {
+        fprintf(stderr, "Can't initialize egl display\n");
+        exit(1);
+    }
+
+    EGLint count;
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &count)) {
+        fprintf(stderr, "Cannot choose EGL config\n");
+        exit(1);
+    }
+
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, 
+                                   (EGLint[]){EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE});
+    if (egl_context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Cannot create EGL context\n");
+        exit(1);
+    }
+
+    const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    has_buffer_age = has_extension(extensions, "EGL_EXT_buffer_age");
+    if (has_extension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+        swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (has_extension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+        swap_buffers_with_damage = (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+            eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+}
+
+static void make_current(struct egl_target *target) {
+    if (current_surface == target->surface) {
+        return;
+    }
+    if (!eglMakeCurrent(egl_display, target->surface, target->surface, egl_context)) {
+        fprintf(stderr, "eglMakeCurrent failed\n");
+        exit(1);
+    }
+    current_surface = target->surface;
+}
+
+static struct render_target *create_egl_surface(struct wl_surface *surface,
+                                                int32_t width, int32_t height) {
+    struct egl_target *target = calloc(1, sizeof(*target));
+    if (target == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    target->base.surface = surface;
+    target->base.width = width;
+    target->base.height = height;
+
+    target->window = wl_egl_window_create(surface, width, height);
+    target->surface = eglCreateWindowSurface(egl_display, config, target->window, NULL);
+    if (target->surface == EGL_NO_SURFACE) {
+        fprintf(stderr, "Failed to create EGL surface\n");
+        exit(1);
+    }
+
+    make_current(target);
+    /* The interval belongs to the surface that is current when it is set. */
+    if (swap_interval != 1) {
+        eglSwapInterval(egl_display, swap_interval);
+    }
+    /* Shaders and the glyph atlas need a current context to be created. */
+    if (!render_ready) {
+        render_init();
+        render_ready = true;
+    }
+    return &target->base;
+}
+
+static void resize_egl_surface(struct render_target *base, int32_t width, int32_t height) {
+    struct egl_target *target = (struct egl_target *)base;
+    /*
+     * Resizing keeps the EGLSurface and the bound context; Mesa picks up the
+     * new size at the next buffer allocation.
+     */
+    base->width = width;
+    base->height = height;
+    damage_history_reset(&base->history);
+    wl_egl_window_resize(target->window, width, height, 0, 0);
+}
+
+static bool acquire_egl(struct render_target *base) {
+    /* EGL allocates and recycles buffers internally. */
+    return true;
+}
+
+static void swap_with_damage(struct egl_target *target, const struct damage *frame_damage) {
+    uint64_t start = stats_now();
+    if (!swap_buffers_with_damage) {
+        eglSwapBuffers(egl_display, target->surface);
+        stats_record(STATS_SWAP, start);
+        return;
+    }
+    EGLint rects[DAMAGE_MAX_RECTS * 4];
+    for (int i = 0; i < frame_damage->count; i++) {
+        const struct rect *r = &frame_damage->rects[i];
+        rects[i * 4 + 0] = r->x;
+        rects[i * 4 + 1] = target->base.height - r->y - r->height;
+        rects[i * 4 + 2] = r->width;
+        rects[i * 4 + 3] = r->height;
+    }
+    swap_buffers_with_damage(egl_display, target->surface, rects, frame_damage->count);
+    stats_record(STATS_SWAP, start);
+}
+
+static void present_egl(struct render_target *base, const struct scene *scene,
+                        const struct damage *damage) {
+    struct egl_target *target = (struct egl_target *)base;
+    make_current(target);
+
+    /*
+     * The back buffer still holds the frame from `age` swaps ago, so only
+     * what changed since then needs repainting. Unknown age means garbage.
+     */
+    struct damage repaint_damage = *damage;
+    EGLint age = 0;
+    if (has_buffer_age) {
+        eglQuerySurface(egl_display, target->surface, EGL_BUFFER_AGE_EXT, &age);
+    }
+    if (!damage_history_accumulate(&base->history, age, &repaint_damage)) {
+        damage_clear(&repaint_damage);
+        damage_add(&repaint_damage, (struct rect){0, 0, base->width, base->height});
+    }
+
+    render_scene(scene, (struct rect){base->x, base->y, base->width, base->height},
+                 &repaint_damage);
+    for (int i = 0; i < base->position_count; i++) {
+        const struct subsurface_position *position = &base->positions[i];
+        wl_subsurface_set_position(position->subsurface, position->x, position->y);
+    }
+    base->position_count = 0;
+    swap_with_damage(target, damage);
+    damage_history_push(&base->history, damage);
+}
+
+static void destroy_egl_surface(struct render_target *base) {
+    struct egl_target *target = (struct egl_target *)base;
+    if (current_surface == target->surface) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        current_surface = EGL_NO_SURFACE;
+    }
+    eglDestroySurface(egl_display, target->surface);
+    wl_egl_window_destroy(target->window);
+    if (base->viewport) wp_viewport_destroy(base->viewport);
+    if (base->subsurface) wl_subsurface_destroy(base->subsurface);
+    wl_surface_destroy(base->surface);
+    free(target);
+}
+
+static void finish_egl(void) {
+    if (egl_display != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (egl_context != EGL_NO_CONTEXT) {
+            eglDestroyContext(egl_display, egl_context);
+        }
+        eglTerminate(egl_display);
+    }
+    render_ready = false;
+    current_surface = EGL_NO_SURFACE;
+}
+
+/* Any target will do; the atlas belongs to the context, not a surface. */
+static void trim_egl(void) {
+    if (render_ready && current_surface != EGL_NO_SURFACE) {
+        render_trim();
+    }
+}
+
+static void set_egl_swap_interval(int interval) {
+    swap_interval = interval;
+}
+
+const struct backend egl_backend = {
+    .name = "egl",
+    .init = init_egl,
+    .create_target = create_egl_surface,
+    .resize_target = resize_egl_surface,
+    .acquire = acquire_egl,
+    .present = present_egl,
+    .destroy_target = destroy_egl_surface,
+    .finish = finish_egl,
+    .set_swap_interval = set_egl_swap_interval,
+    .trim = trim_egl,
+};
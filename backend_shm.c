@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcft/fcft.h>
+#include <pixman.h>
+#include <wayland-client.h>
+#include "viewporter-client-protocol.h"
+#include "backend.h"
+#include "stats.h"
+
+/*
+ * Software rendering into memfd-backed wl_shm buffers with pixman. Nothing
+ * GL is touched, so no driver is loaded. Up to SHM_BUFFERS buffers are kept
+ * per surface and recycled when the compositor releases them; a buffer's
+ * age is derived from the frame it last held, exactly like EGL_EXT_buffer_age.
+ */
+#define SHM_BUFFERS 3
+
+struct shm_buffer {
+    struct wl_buffer *buffer;
+    pixman_image_t *image;
+    void *data;
+    size_t size;
+    int32_t width, height;
+    bool busy;
+    uint64_t frame;
+};
+
+struct shm_target {
+    struct render_target base;
+    struct shm_buffer buffers[SHM_BUFFERS];
+    struct shm_buffer *current;
+    uint64_t frame_count;
+};
+
+static struct wl_shm *shm;
+
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct shm_buffer *buffer = data;
+    buffer->busy = false;
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static void destroy_buffer(struct shm_buffer *buffer) {
+    if (buffer->buffer == NULL) {
+        return;
+    }
+    wl_buffer_destroy(buffer->buffer);
+    pixman_image_unref(buffer->image);
+    munmap(buffer->data, buffer->size);
+    *buffer = (struct shm_buffer){0};
+}
+
+static bool create_buffer(struct shm_buffer *buffer, int32_t width, int32_t height) {
+    int32_t stride = width * 4;
+    size_t size = (size_t)stride * height;
+
+    int fd = memfd_create("mypanel-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        perror("memfd_create");
+        return false;
+    }
+    if (ftruncate(fd, size) < 0) {
+        perror("ftruncate");
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return false;
+    }
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+    buffer->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+                                               WL_SHM_FORMAT_ARGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+
+    buffer->image = pixman_image_create_bits_no_clear(PIXMAN_a8r8g8b8, width, height,
+                                                      data, stride);
+    buffer->data = data;
+    buffer->size = size;
+    buffer->width = width;
+    buffer->height = height;
+    buffer->busy = false;
+    buffer->frame = 0;
+    wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+    return true;
+}
+
+static void init_shm(struct wl_display *display, struct wl_shm *wl_shm) {
+    if (wl_shm == NULL) {
+        fprintf(stderr, "wl_shm not available\n");
+        exit(1);
+    }
+    shm = wl_shm;
+}
+
+static struct render_target *create_shm_target(struct wl_surface *surface,
+                                               int32_t width, int32_t height) {
+    struct shm_target *target = calloc(1, sizeof(*target));
+    if (target == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    target->base.surface = surface;
+    target->base.width = width;
+    target->base.height = height;
+    return &target->base;
+}
+
+static void resize_shm_target(struct render_target *base, int32_t width, int32_t height) {
+    struct shm_target *target = (struct shm_target *)base;
+    base->width = width;
+    base->height = height;
+    damage_history_reset(&base->history);
+    /* Buffers still held by the compositor are replaced once released. */
+    for (int i = 0; i < SHM_BUFFERS; i++) {
+        if (!target->buffers[i].busy) {
+            destroy_buffer(&target->buffers[i]);
+        }
+    }
+}
+
+static bool acquire_shm(struct render_target *base) {
+    struct shm_target *target = (struct shm_target *)base;
+    struct shm_buffer *empty = NULL;
+
+    target->current = NULL;
+    for (int i = 0; i < SHM_BUFFERS; i++) {
+        struct shm_buffer *buffer = &target->buffers[i];
+        if (buffer->busy) {
+            continue;
+        }
+        if (buffer->buffer && (buffer->width != base->width || buffer->height != base->height)) {
+            destroy_buffer(buffer);
+        }
+        if (buffer->buffer == NULL) {
+            empty = empty ? empty : buffer;
+            continue;
+        }
+        /* Prefer the most recently drawn buffer: it needs the least repaint. */
+        if (target->current == NULL || buffer->frame > target->current->frame) {
+            target->current = buffer;
+        }
+    }
+
+    if (target->current == NULL && empty) {
+        if (!create_buffer(empty, base->width, base->height)) {
+            return false;
+        }
+        target->current = empty;
+    }
+    return target->current != NULL;
+}
+
+static pixman_color_t to_pixman_color(uint32_t argb) {
+    uint16_t a = (argb >> 24) * 0x101;
+    return (pixman_color_t){
+        .red = ((argb >> 16) & 0xff) * 0x101 * a / 0xffff,
+        .green = ((argb >> 8) & 0xff) * 0x101 * a / 0xffff,
+        .blue = (argb & 0xff) * 0x101 * a / 0xffff,
+        .alpha = a,
+    };
+}
+
+static void fill(pixman_image_t *image, uint32_t argb, struct rect r) {
+    pixman_color_t color = to_pixman_color(argb);
+    pixman_image_t *solid = pixman_image_create_solid_fill(&color);
+    pixman_image_composite32(PIXMAN_OP_SRC, solid, NULL, image,
+                             0, 0, 0, 0, r.x, r.y, r.width, r.height);
+    pixman_image_unref(solid);
+}
+
+static void draw_block(pixman_image_t *image, const struct scene *scene,
+                       const struct block *block, int32_t dx, int32_t dy) {
+    struct rect box = block->box;
+    box.x += dx;
+    box.y += dy;
+    fill(image, block->bg, box);
+
+    pixman_color_t color = to_pixman_color(block->fg);
+    pixman_image_t *fg = pixman_image_create_solid_fill(&color);
+    int32_t baseline = scene_baseline(scene) + dy;
+    int32_t pen = box.x + scene->padding;
+    for (int i = 0; i < block->length; i++) {
+        const struct fcft_glyph *glyph = fcft_rasterize_char_utf32(
+            scene->font, block->codepoints[i], FCFT_SUBPIXEL_DEFAULT);
+        if (glyph == NULL) {
+            continue;
+        }
+        int32_t x = pen + glyph->x, y = baseline - glyph->y;
+        if (pixman_image_get_format(glyph->pix) == PIXMAN_a8r8g8b8 &&
+            !pixman_image_get_component_alpha(glyph->pix)) {
+            /* Colour glyph (emoji): drawn as is. */
+            pixman_image_composite32(PIXMAN_OP_OVER, glyph->pix, NULL, image,
+                                     0, 0, 0, 0, x, y, glyph->width, glyph->height);
+        } else {
+            /* Component alpha makes pixman blend subpixel masks per channel. */
+            pixman_image_composite32(PIXMAN_OP_OVER, fg, glyph->pix, image,
+                                     0, 0, 0, 0, x, y, glyph->width, glyph->height);
+        }
+        pen += glyph->advance.x;
+    }
+    pixman_image_unref(fg);
+}
+
+/*
+ * Everything outside the damage is clipped away by the image's clip region.
+ * The image shows the scene from (x, y) on.
+ */
+static void repaint(pixman_image_t *image, const struct scene *scene,
+                    int32_t x, int32_t y, const struct damage *damage) {
+    pixman_box32_t boxes[DAMAGE_MAX_RECTS];
+    for (int i = 0; i < damage->count; i++) {
+        const struct rect *r = &damage->rects[i];
+        boxes[i] = (pixman_box32_t){r->x, r->y, r->x + r->width, r->y + r->height};
+    }
+    pixman_region32_t clip;
+    pixman_region32_init_rects(&clip, boxes, damage->count);
+    pixman_image_set_clip_region32(image, &clip);
+
+    fill(image, scene->background, (struct rect){0, 0, pixman_image_get_width(image),
+                                                 pixman_image_get_height(image)});
+    for (int i = 0; i < scene->count; i++) {
+        const struct block *block = &scene->blocks[i];
+        if (pixman_region32_contains_rectangle(&clip, &(pixman_box32_t){
+                block->box.x - x, block->box.y - y,
+                block->box.x - x + block->box.width,
+                block->box.y - y + block->box.height}) != PIXMAN_REGION_OUT) {
+            draw_block(image, scene, block, -x, -y);
+        }
+    }
+
+    pixman_image_set_clip_region32(image, NULL);
+    pixman_region32_fini(&clip);
+}
+
+static void present_shm(struct render_target *base, const struct scene *scene,
+                        const struct damage *damage) {
+    struct shm_target *target = (struct shm_target *)base;
+    struct shm_buffer *buffer = target->current;
+
+    target->frame_count++;
+    int age = buffer->frame ? (int)(target->frame_count - buffer->frame) : 0;
+
+    struct damage repaint_damage = *damage;
+    if (!damage_history_accumulate(&base->history, age, &repaint_damage)) {
+        damage_clear(&repaint_damage);
+        damage_add(&repaint_damage, (struct rect){0, 0, base->width, base->height});
+    }
+    repaint(buffer->image, scene, base->x, base->y, &repaint_damage);
+
+    uint64_t start = stats_now();
+    wl_surface_attach(base->surface, buffer->buffer, 0, 0);
+    for (int i = 0; i < damage->count; i++) {
+        const struct rect *r = &damage->rects[i];
+        wl_surface_damage_buffer(base->surface, r->x, r->y, r->width, r->height);
+    }
+    for (int i = 0; i < base->position_count; i++) {
+        const struct subsurface_position *position = &base->positions[i];
+        wl_subsurface_set_position(position->subsurface, position->x, position->y);
+    }
+    base->position_count = 0;
+    wl_surface_commit(base->surface);
+    stats_record(STATS_SWAP, start);
+
+    buffer->busy = true;
+    buffer->frame = target->frame_count;
+    target->current = NULL;
+    damage_history_push(&base->history, damage);
+}
+
+static void destroy_shm_target(struct render_target *base) {
+    struct shm_target *target = (struct shm_target *)base;
+    for (int i = 0; i < SHM_BUFFERS; i++) {
+        destroy_buffer(&target->buffers[i]);
+    }
+    if (base->viewport) wp_viewport_destroy(base->viewport);
+    if (base->subsurface) wl_subsurface_destroy(base->subsurface);
+    wl_surface_destroy(base->surface);
+    free(target);
+}
+
+static void finish_shm(void) {
+    shm = NULL;
+}
+
+const struct backend shm_backend = {
+    .name = "shm",
+    .init = init_shm,
+    .create_target = create_shm_target,
+    .resize_target = resize_shm_target,
+    .acquire = acquire_shm,
+    .present = present_shm,
+    .destroy_target = destroy_shm_target,
+    .finish = finish_shm,
+};
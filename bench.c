@@ -0,0 +1,668 @@
+/*
+ * Headless renderer benchmark. Replays a script of damage updates through
+ * render_scene() against an offscreen target and prints per-scenario frame
+ * statistics as JSON on stdout. No compositor is needed: EGL runs on
+ * EGL_MESA_platform_surfaceless when available, or on a pbuffer otherwise,
+ * so llvmpipe on a build machine is enough.
+ *
+ * Script format, one command per line ('#' starts a comment):
+ *   scenario NAME     start a new scenario and forget previous damage
+ *   size W H          resize the target (kept across scenarios)
+ *   status TEXT       set the bar contents; '|' separates blocks
+ *   style R B M S     block corner radius, border width, margin and shadow
+ *   damage X Y W H    region changed in every frame of the scenario
+ *   tick N            count up the digits of block N (0 is the first) in
+ *                     every frame, adding whatever the change damages
+ *   frames N          render N frames with the current damage
+ *   cpu N TICKS       time TICKS updates of the cpu module on a generated
+ *                     /proc/stat with N CPUs
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <fcft/fcft.h>
+#include "atlas.h"
+#include "damage.h"
+#include "module.h"
+#include "render.h"
+#include "scene.h"
+
+#define MAX_SCENARIOS 32
+#define FONT_NAME "monospace:size=10"
+
+static const char default_script[] =
+    "# Full redraw of a 4K-wide bar, as after a configure\n"
+    "scenario full\n"
+    "size 3840 30\n"
+    "status 1 2 3 4 5|mypanel — ~/src|♪ 42%|⚡ 87%|12:34:56\n"
+    "damage 0 0 3840 30\n"
+    "frames 300\n"
+    "# A clock tick: the clock's text changes\n"
+    "scenario clock\n"
+    "tick 4\n"
+    "frames 300\n"
+    "# Workspace switch, window title and clock in one frame\n"
+    "scenario scattered\n"
+    "tick 0\n"
+    "tick 4\n"
+    "damage 800 0 1600 30\n"
+    "frames 300\n"
+    "# The same, with rounded, bordered and shadowed blocks\n"
+    "scenario shapes\n"
+    "style 8 1 3 2\n"
+    "tick 0\n"
+    "tick 4\n"
+    "damage 800 0 1600 30\n"
+    "frames 300\n"
+    "# One cpu module tick on a 256-CPU machine\n"
+    "scenario cpu256\n"
+    "cpu 256 1000\n";
+
+/*
+ * Allocation counting. Every heap allocation in the process goes through
+ * these, including the ones made by the GL driver on its own threads.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static uint64_t alloc_count;
+
+static void count_alloc(void) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    count_alloc();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    count_alloc();
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc();
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count_alloc();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+    count_alloc();
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : 12 /* ENOMEM */;
+}
+
+struct samples {
+    uint64_t *values;
+    int count;
+};
+
+struct scenario {
+    char name[64];
+    int32_t width, height;
+    /* Damaged pixels over all frames. */
+    int64_t pixels;
+    struct samples frame_cpu, frame_wall, gl_submit, allocs;
+    uint64_t uploaded_pixels;
+    /* Non-zero for cpu module scenarios, whose samples are ticks. */
+    int cpus;
+};
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context;
+static EGLSurface egl_surface = EGL_NO_SURFACE;
+static const char *platform = "pbuffer";
+/* Shader setup; near zero once the program binary cache is warm. */
+static uint64_t render_init_ns;
+static GLuint fbo, color_texture;
+static int32_t target_width, target_height;
+static struct fcft_font *font;
+static struct scene scene;
+/* The scripted status, tab separated, and the blocks whose digits tick. */
+static char status_text[256];
+static uint32_t ticking;
+static uint64_t tick_count;
+
+static struct scenario scenarios[MAX_SCENARIOS];
+static int scenario_count;
+/* The generated /proc/stat; a memfd the cpu module opens by path. */
+static int stat_fd = -1;
+static char stat_path[32];
+static char stat_text[1 << 18];
+
+static uint64_t now_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void init_egl(void) {
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                               EGL_DEFAULT_DISPLAY, NULL);
+            platform = "surfaceless";
+        }
+    }
+    if (egl_display == EGL_NO_DISPLAY) {
+        egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        platform = "pbuffer";
+    }
+    if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL)) {
+        fprintf(stderr, "Can't initialize egl display\n");
+        exit(1);
+    }
+    eglBindAPI(EGL_OPENGL_ES_API);
+
+    EGLint count;
+    EGLConfig config;
+    EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &count) || count == 0) {
+        fprintf(stderr, "Cannot choose EGL config\n");
+        exit(1);
+    }
+
+    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT,
+                                   (EGLint[]){EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE});
+    if (egl_context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "Cannot create EGL context\n");
+        exit(1);
+    }
+
+    /* Rendering always goes to an FBO; the pbuffer only makes it current. */
+    const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+    if (!has_extension(extensions, "EGL_KHR_surfaceless_context")) {
+        egl_surface = eglCreatePbufferSurface(egl_display, config,
+                                              (EGLint[]){EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE});
+        if (egl_surface == EGL_NO_SURFACE) {
+            fprintf(stderr, "Failed to create pbuffer surface\n");
+            exit(1);
+        }
+    }
+    if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
+        fprintf(stderr, "eglMakeCurrent failed\n");
+        exit(1);
+    }
+
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &color_texture);
+    uint64_t start = now_ns(CLOCK_MONOTONIC);
+    render_init();
+    render_init_ns = now_ns(CLOCK_MONOTONIC) - start;
+}
+
+/* Every size and status starts from a fully painted target. */
+static void repaint_full(void) {
+    struct damage full = {0};
+    damage_add(&full, (struct rect){0, 0, target_width, target_height});
+    render_scene(&scene, (struct rect){0, 0, target_width, target_height}, &full);
+    glFinish();
+}
+
+static void set_style(int radius, int border_width, int margin, int shadow) {
+    struct block_style style = {
+        .radius = radius,
+        .border_width = border_width,
+        .border_color = 0xff555555,
+        .margin = margin,
+        .shadow = shadow,
+    };
+    scene_set_style(&scene, &style);
+    if (target_width > 0) {
+        repaint_full();
+    }
+}
+
+static void set_status(const char *status) {
+    snprintf(status_text, sizeof(status_text), "%s", status);
+    for (char *p = status_text; *p; p++) {
+        if (*p == '|') {
+            *p = '\t';
+        }
+    }
+    struct damage damage = {0};
+    scene_set_status(&scene, status_text, &damage);
+    if (target_width > 0) {
+        repaint_full();
+    }
+}
+
+static void resize_target(int32_t width, int32_t height) {
+    if (width == target_width && height == target_height) {
+        return;
+    }
+    target_width = width;
+    target_height = height;
+
+    glBindTexture(GL_TEXTURE_2D, color_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, color_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Offscreen framebuffer incomplete\n");
+        exit(1);
+    }
+
+    scene_resize(&scene, width, height);
+    repaint_full();
+}
+
+static void samples_init(struct samples *samples, int capacity) {
+    samples->values = calloc(capacity, sizeof(*samples->values));
+    samples->count = 0;
+    if (samples->values == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+}
+
+/* Advances every digit of the ticking blocks by one, as a frame's update. */
+static void tick_status(struct damage *damage) {
+    char text[sizeof(status_text)];
+    int block = 0;
+    tick_count++;
+    for (size_t i = 0; i < sizeof(text); i++) {
+        char c = status_text[i];
+        if (c == '\t') {
+            block++;
+        } else if (c >= '0' && c <= '9' && block < 32 && (ticking & (1u << block))) {
+            c = '0' + (c - '0' + tick_count) % 10;
+        }
+        text[i] = c;
+        if (c == '\0') {
+            break;
+        }
+    }
+    scene_set_status(&scene, text, damage);
+}
+
+/* Makes room for `count` more samples of every kind. */
+static void samples_reserve(struct scenario *scenario, int count) {
+    struct samples *all[] = {
+        &scenario->frame_cpu, &scenario->frame_wall,
+        &scenario->gl_submit, &scenario->allocs,
+    };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (all[i]->values == NULL) {
+            samples_init(all[i], count);
+        } else {
+            uint64_t *values = realloc(all[i]->values,
+                                       (all[i]->count + count) * sizeof(uint64_t));
+            if (values == NULL) {
+                perror("realloc");
+                exit(1);
+            }
+            all[i]->values = values;
+        }
+    }
+}
+
+static void run_frames(struct scenario *scenario, const struct damage *damage, int frames) {
+    struct samples *all[] = {
+        &scenario->frame_cpu, &scenario->frame_wall,
+        &scenario->gl_submit, &scenario->allocs,
+    };
+    samples_reserve(scenario, frames);
+
+    scenario->width = target_width;
+    scenario->height = target_height;
+    struct atlas_stats before, after;
+    atlas_get_stats(&before);
+
+    for (int i = 0; i < frames; i++) {
+        struct damage frame_damage = *damage;
+        uint64_t allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+        uint64_t wall = now_ns(CLOCK_MONOTONIC);
+
+        /* Layout and glyph rasterization are part of the frame. */
+        if (ticking) {
+            tick_status(&frame_damage);
+        }
+        damage_clip(&frame_damage, target_width, target_height);
+        render_scene(&scene, (struct rect){0, 0, target_width, target_height}, &frame_damage);
+        glFlush();
+        uint64_t submitted = now_ns(CLOCK_MONOTONIC);
+        glFinish();
+
+        int n = scenario->frame_cpu.count;
+        scenario->frame_cpu.values[n] = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        scenario->frame_wall.values[n] = now_ns(CLOCK_MONOTONIC) - wall;
+        scenario->gl_submit.values[n] = submitted - wall;
+        scenario->allocs.values[n] = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs;
+        scenario->pixels += damage_area(&frame_damage);
+        for (size_t j = 0; j < sizeof(all) / sizeof(all[0]); j++) {
+            all[j]->count++;
+        }
+    }
+    atlas_get_stats(&after);
+    scenario->uploaded_pixels += after.uploaded_pixels - before.uploaded_pixels;
+}
+
+/*
+ * Writes a /proc/stat for `cpus` CPUs as it would read after `tick` ticks:
+ * kernel sized counters, each CPU busy a different share, and the
+ * interrupt and scheduler lines that follow the cpu lines.
+ */
+static void write_stat(int cpus, int tick) {
+    size_t length = 0;
+    for (int cpu = -1; cpu < cpus; cpu++) {
+        uint64_t n = cpu < 0 ? cpus : 1;
+        uint64_t base = 1000000 + (cpu + 1) * 7919;
+        uint64_t busy = tick * (cpu + 2) % 200;
+        char name[16] = "cpu ";
+        if (cpu >= 0) {
+            snprintf(name, sizeof(name), "cpu%d", cpu);
+        }
+        length += snprintf(stat_text + length, sizeof(stat_text) - length,
+                           "%s %llu %llu %llu %llu %llu %llu %llu 0 0 0\n", name,
+                           (unsigned long long)(n * (base * 3 + busy)),
+                           (unsigned long long)(n * base / 50),
+                           (unsigned long long)(n * (base + busy / 2)),
+                           (unsigned long long)(n * (base * 40 + tick * 200 - busy)),
+                           (unsigned long long)(n * base / 20),
+                           0ULL,
+                           (unsigned long long)(n * base / 100));
+    }
+    length += snprintf(stat_text + length, sizeof(stat_text) - length,
+                       "intr %llu 9 0 0 0 0 0 0 0 1 0 0 0 143 0 0 0\n"
+                       "ctxt %llu\nbtime 1700000000\nprocesses %d\n"
+                       "procs_running 2\nprocs_blocked 0\n",
+                       123456789ULL + tick * 1000ULL, 987654321ULL + tick * 5000ULL,
+                       40000 + tick);
+    if (length >= sizeof(stat_text)) {
+        fprintf(stderr, "Generated /proc/stat too large\n");
+        exit(1);
+    }
+    if (ftruncate(stat_fd, 0) < 0 || pwrite(stat_fd, stat_text, length, 0) != (ssize_t)length) {
+        perror("stat");
+        exit(1);
+    }
+}
+
+/* Times the cpu module's update alone; rewriting the file is left out. */
+static void run_cpu_ticks(struct scenario *scenario, int cpus, int ticks) {
+    if (stat_fd < 0) {
+        stat_fd = memfd_create("stat", MFD_CLOEXEC);
+        if (stat_fd < 0) {
+            perror("memfd_create");
+            exit(1);
+        }
+        snprintf(stat_path, sizeof(stat_path), "/proc/self/fd/%d", stat_fd);
+        cpu_stat_path = stat_path;
+    }
+    write_stat(cpus, 0);
+    struct module module = {.type = &cpu_module};
+    if (!cpu_module.init(&module)) {
+        perror(stat_path);
+        exit(1);
+    }
+    samples_reserve(scenario, ticks);
+    scenario->cpus = cpus;
+
+    for (int i = 0; i < ticks; i++) {
+        write_stat(cpus, i + 1);
+        uint64_t allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        uint64_t cpu = now_ns(CLOCK_THREAD_CPUTIME_ID);
+        uint64_t wall = now_ns(CLOCK_MONOTONIC);
+
+        cpu_module.update(&module);
+
+        int n = scenario->frame_cpu.count++;
+        scenario->frame_cpu.values[n] = now_ns(CLOCK_THREAD_CPUTIME_ID) - cpu;
+        scenario->frame_wall.values[n] = now_ns(CLOCK_MONOTONIC) - wall;
+        scenario->gl_submit.values[n] = 0;
+        scenario->allocs.values[n] = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs;
+        scenario->frame_wall.count++;
+        scenario->gl_submit.count++;
+        scenario->allocs.count++;
+    }
+    cpu_module.finish(&module);
+}
+
+static void run_script(const char *script) {
+    struct scenario *scenario = NULL;
+    struct damage damage = {0};
+    char line[256];
+    const char *p = script;
+
+    while (*p) {
+        size_t len = strcspn(p, "\n");
+        if (len >= sizeof(line)) {
+            len = sizeof(line) - 1;
+        }
+        memcpy(line, p, len);
+        line[len] = '\0';
+        p += strcspn(p, "\n");
+        if (*p == '\n') {
+            p++;
+        }
+
+        char name[64];
+        int a, b, c, d;
+        if (line[0] == '#' || line[strspn(line, " \t")] == '\0') {
+            continue;
+        } else if (sscanf(line, "scenario %63s", name) == 1) {
+            if (scenario_count == MAX_SCENARIOS) {
+                fprintf(stderr, "Too many scenarios\n");
+                exit(1);
+            }
+            scenario = &scenarios[scenario_count++];
+            snprintf(scenario->name, sizeof(scenario->name), "%s", name);
+            damage_clear(&damage);
+            if (ticking) {
+                /* Back to the scripted text before the next scenario. */
+                struct damage restored = {0};
+                ticking = 0;
+                scene_set_status(&scene, status_text, &restored);
+                repaint_full();
+            }
+        } else if (sscanf(line, "size %d %d", &a, &b) == 2) {
+            resize_target(a, b);
+        } else if (strncmp(line, "status ", 7) == 0) {
+            set_status(line + 7);
+        } else if (sscanf(line, "style %d %d %d %d", &a, &b, &c, &d) == 4) {
+            set_style(a, b, c, d);
+        } else if (sscanf(line, "damage %d %d %d %d", &a, &b, &c, &d) == 4) {
+            damage_add(&damage, (struct rect){a, b, c, d});
+        } else if (sscanf(line, "tick %d", &a) == 1) {
+            if (a < 0 || a >= 32) {
+                fprintf(stderr, "tick needs a block from 0 to 31\n");
+                exit(1);
+            }
+            ticking |= 1u << a;
+        } else if (sscanf(line, "frames %d", &a) == 1) {
+            if (scenario == NULL || target_width == 0) {
+                fprintf(stderr, "frames needs a scenario and a size\n");
+                exit(1);
+            }
+            run_frames(scenario, &damage, a);
+        } else if (sscanf(line, "cpu %d %d", &a, &b) == 2) {
+            if (scenario == NULL || a < 1 || a > 1024) {
+                fprintf(stderr, "cpu needs a scenario and 1 to 1024 CPUs\n");
+                exit(1);
+            }
+            run_cpu_ticks(scenario, a, b);
+        } else {
+            fprintf(stderr, "Bad script line: %s\n", line);
+            exit(1);
+        }
+    }
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_percentiles(const char *key, struct samples *samples, double scale) {
+    qsort(samples->values, samples->count, sizeof(uint64_t), compare_u64);
+    int p99 = samples->count * 99 / 100;
+    if (p99 >= samples->count) {
+        p99 = samples->count - 1;
+    }
+    printf("\"%s\": {\"p50\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+           key, samples->values[samples->count / 2] / scale,
+           samples->values[p99] / scale, samples->values[samples->count - 1] / scale);
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            putchar('\\');
+        }
+        if ((unsigned char)*s >= 0x20) {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void print_report(void) {
+    printf("{\"platform\": ");
+    print_json_string(platform);
+    printf(", \"renderer\": ");
+    print_json_string((const char *)glGetString(GL_RENDERER));
+    printf(", \"render_init_us\": %.3f", render_init_ns / 1e3);
+    printf(", \"scenarios\": [");
+    bool printed = false;
+    for (int i = 0; i < scenario_count; i++) {
+        struct scenario *s = &scenarios[i];
+        if (s->frame_cpu.count == 0) {
+            continue;
+        }
+        uint64_t total_allocs = 0;
+        for (int j = 0; j < s->allocs.count; j++) {
+            total_allocs += s->allocs.values[j];
+        }
+        printf("%s\n  {\"name\": ", printed ? "," : "");
+        printed = true;
+        print_json_string(s->name);
+        if (s->cpus > 0) {
+            printf(", \"module\": \"cpu\", \"cpus\": %d, \"ticks\": %d, ",
+                   s->cpus, s->frame_cpu.count);
+            print_percentiles("tick_cpu_us", &s->frame_cpu, 1e3);
+            printf(", ");
+            print_percentiles("tick_wall_us", &s->frame_wall, 1e3);
+            printf(", \"allocs_per_tick\": %.2f}", (double)total_allocs / s->allocs.count);
+            continue;
+        }
+        printf(", \"frames\": %d, \"width\": %d, \"height\": %d, \"pixels_per_frame\": %lld, ",
+               s->frame_cpu.count, s->width, s->height,
+               (long long)(s->pixels / s->frame_cpu.count));
+        print_percentiles("frame_cpu_us", &s->frame_cpu, 1e3);
+        printf(", ");
+        print_percentiles("frame_wall_us", &s->frame_wall, 1e3);
+        printf(", ");
+        print_percentiles("gl_submit_us", &s->gl_submit, 1e3);
+        printf(", \"allocs_per_frame\": {\"mean\": %.2f, ",
+               (double)total_allocs / s->allocs.count);
+        print_percentiles("dist", &s->allocs, 1.0);
+        printf("}, \"atlas_upload_pixels\": %llu}", (unsigned long long)s->uploaded_pixels);
+    }
+    printf("\n]}\n");
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    size_t size = 0, capacity = 4096;
+    char *data = malloc(capacity);
+    size_t n;
+    while (data && (n = fread(data + size, 1, capacity - size - 1, f)) > 0) {
+        size += n;
+        if (capacity - size == 1) {
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (grown == NULL) {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    fclose(f);
+    if (data == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    data[size] = '\0';
+    return data;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [script]\n", argv[0]);
+        return 1;
+    }
+
+    fcft_init(FCFT_LOG_COLORIZE_NEVER, false, FCFT_LOG_CLASS_ERROR);
+    font = fcft_from_name(1, (const char *[]){FONT_NAME}, NULL);
+    if (font == NULL) {
+        fprintf(stderr, "Failed to load font %s\n", FONT_NAME);
+        return 1;
+    }
+    scene_init(&scene, font);
+
+    init_egl();
+    if (argc == 2) {
+        char *script = read_file(argv[1]);
+        run_script(script);
+        free(script);
+    } else {
+        run_script(default_script);
+    }
+    print_report();
+
+    render_finish();
+    glDeleteTextures(1, &color_texture);
+    glDeleteFramebuffers(1, &fbo);
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (egl_surface != EGL_NO_SURFACE) {
+        eglDestroySurface(egl_display, egl_surface);
+    }
+    eglDestroyContext(egl_display, egl_context);
+    eglTerminate(egl_display);
+    fcft_destroy(font);
+    fcft_fini();
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <string.h>
+#include "damage.h"
+
+static bool rect_empty(struct rect r) {
+    return r.width <= 0 || r.height <= 0;
+}
+
+static struct rect rect_union(struct rect a, struct rect b) {
+    int32_t x1 = a.x < b.x ? a.x : b.x;
+    int32_t y1 = a.y < b.y ? a.y : b.y;
+    int32_t x2 = a.x + a.width > b.x + b.width ? a.x + a.width : b.x + b.width;
+    int32_t y2 = a.y + a.height > b.y + b.height ? a.y + a.height : b.y + b.height;
+    return (struct rect){x1, y1, x2 - x1, y2 - y1};
+}
+
+static bool rect_touches(struct rect a, struct rect b) {
+    return a.x <= b.x + b.width && b.x <= a.x + a.width &&
+           a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+static int64_t rect_area(struct rect r) {
+    return (int64_t)r.width * r.height;
+}
+
+void damage_clear(struct damage *damage) {
+    damage->count = 0;
+}
+
+static void damage_remove(struct damage *damage, int i) {
+    damage->rects[i] = damage->rects[--damage->count];
+}
+
+void damage_add(struct damage *damage, struct rect rect) {
+    if (rect_empty(rect)) {
+        return;
+    }
+
+    /* Absorb every rectangle that overlaps or abuts the new one. */
+    for (int i = 0; i < damage->count;) {
+        if (rect_touches(damage->rects[i], rect)) {
+            rect = rect_union(rect, damage->rects[i]);
+            damage_remove(damage, i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+
+    if (damage->count < DAMAGE_MAX_RECTS) {
+        damage->rects[damage->count++] = rect;
+        return;
+    }
+
+    /* Full: merge the new rectangle into the one that wastes least area. */
+    int best = 0;
+    int64_t best_waste = INT64_MAX;
+    for (int i = 0; i < damage->count; i++) {
+        struct rect u = rect_union(damage->rects[i], rect);
+        int64_t waste = rect_area(u) - rect_area(damage->rects[i]) - rect_area(rect);
+        if (waste < best_waste) {
+            best_waste = waste;
+            best = i;
+        }
+    }
+    rect = rect_union(damage->rects[best], rect);
+    damage_remove(damage, best);
+    damage_add(damage, rect);
+}
+
+void damage_union(struct damage *dst, const struct damage *src) {
+    for (int i = 0; i < src->count; i++) {
+        damage_add(dst, src->rects[i]);
+    }
+}
+
+void damage_clip(struct damage *damage, int32_t width, int32_t height) {
+    for (int i = 0; i < damage->count;) {
+        struct rect *r = &damage->rects[i];
+        int32_t x2 = r->x + r->width > width ? width : r->x + r->width;
+        int32_t y2 = r->y + r->height > height ? height : r->y + r->height;
+        r->x = r->x < 0 ? 0 : r->x;
+        r->y = r->y < 0 ? 0 : r->y;
+        r->width = x2 - r->x;
+        r->height = y2 - r->y;
+        if (rect_empty(*r)) {
+            damage_remove(damage, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+struct rect damage_extents(const struct damage *damage) {
+    if (damage->count == 0) {
+        return (struct rect){0, 0, 0, 0};
+    }
+    struct rect extents = damage->rects[0];
+    for (int i = 1; i < damage->count; i++) {
+        extents = rect_union(extents, damage->rects[i]);
+    }
+    return extents;
+}
+
+int64_t damage_area(const struct damage *damage) {
+    int64_t area = 0;
+    for (int i = 0; i < damage->count; i++) {
+        area += rect_area(damage->rects[i]);
+    }
+    return area;
+}
+
+void damage_history_reset(struct damage_history *history) {
+    memset(history, 0, sizeof(*history));
+}
+
+void damage_history_push(struct damage_history *history, const struct damage *damage) {
+    history->head = (history->head + 1) % DAMAGE_HISTORY;
+    history->frames[history->head] = *damage;
+    if (history->count < DAMAGE_HISTORY) {
+        history->count++;
+    }
+}
+
+bool damage_history_accumulate(const struct damage_history *history, int age,
+                               struct damage *out) {
+    if (age <= 0 || age - 1 > history->count) {
+        return false;
+    }
+    for (int i = 0; i < age - 1; i++) {
+        int index = (history->head - i + DAMAGE_HISTORY) % DAMAGE_HISTORY;
+        damage_union(out, &history->frames[index]);
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Damage is kept as a short list of rectangles in surface-local coordinates
+ * with a top-left origin. Rectangles that overlap or touch a new one are
+ * merged into it. When the list is full, the new rectangle is merged into
+ * the existing one whose union with it wastes the least area, so the list
+ * never grows.
+ */
+#define DAMAGE_MAX_RECTS 8
+
+/* Number of previous frames remembered for EGL_EXT_buffer_age. */
+#define DAMAGE_HISTORY 4
+
+struct rect {
+    int32_t x, y, width, height;
+};
+
+struct damage {
+    struct rect rects[DAMAGE_MAX_RECTS];
+    int count;
+};
+
+struct damage_history {
+    struct damage frames[DAMAGE_HISTORY];
+    int head;
+    int count;
+};
+
+void damage_clear(struct damage *damage);
+void damage_add(struct damage *damage, struct rect rect);
+void damage_union(struct damage *dst, const struct damage *src);
+void damage_clip(struct damage *damage, int32_t width, int32_t height);
+struct rect damage_extents(const struct damage *damage);
+int64_t damage_area(const struct damage *damage);
+
+void damage_history_reset(struct damage_history *history);
+void damage_history_push(struct damage_history *history, const struct damage *damage);
+/*
+ * Adds the damage of the last age - 1 frames to out. Returns false when the
+ * buffer contents are undefined (age 0) or older than the history, in which
+ * case the caller must repaint everything.
+ */
+bool damage_history_accumulate(const struct damage_history *history, int age,
+                               struct damage *out);
+
+#endif
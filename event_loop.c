@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "frame_timing.h"
+
+#define MAX_EVENTS 32
+
+enum event_source_type {
+    EVENT_SOURCE_FD,
+    EVENT_SOURCE_TIMER,
+    EVENT_SOURCE_SIGNAL,
+};
+
+struct event_source {
+    enum event_source_type type;
+    int fd;
+    /* Timers only. */
+    clockid_t clock;
+    event_callback callback;
+    void *data;
+    const char *name;
+    uint64_t wakeups;
+    bool removed;
+    struct event_source *next;
+    struct event_source *next_removed;
+};
+
+static int epoll_fd = -1;
+static struct event_source *sources;
+
+/*
+ * All signals share one signalfd; the per-signal callbacks are looked up by
+ * number when a siginfo is read from it.
+ */
+static struct event_source *signal_source;
+static struct event_source *signal_handlers[_NSIG];
+
+/* What event_source_timer_update_vblank() aims at, on frame_timing_clock. */
+static struct frame_timing frame_timing;
+static clockid_t frame_timing_clock;
+static sigset_t signal_mask;
+
+/*
+ * Sources removed from inside a callback may still appear later in the same
+ * epoll_wait batch, so they are only freed once the batch is done.
+ */
+static struct event_source *removed_sources;
+static bool dispatching;
+
+void event_loop_init(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    sigemptyset(&signal_mask);
+}
+
+static struct event_source *new_source(enum event_source_type type, int fd,
+                                       event_callback callback, void *data) {
+    struct event_source *source = calloc(1, sizeof(*source));
+    if (source == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    source->type = type;
+    source->fd = fd;
+    source->callback = callback;
+    source->data = data;
+    return source;
+}
+
+static bool watch_fd(struct event_source *source, uint32_t events) {
+    struct epoll_event ev = {.events = events, .data.ptr = source};
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source->fd, &ev) == 0;
+}
+
+static struct event_source *add_source(enum event_source_type type, int fd,
+                                       uint32_t events, event_callback callback,
+                                       void *data) {
+    struct event_source *source = new_source(type, fd, callback, data);
+    if (!watch_fd(source, events)) {
+        int err = errno;
+        free(source);
+        errno = err;
+        return NULL;
+    }
+    source->next = sources;
+    sources = source;
+    return source;
+}
+
+struct event_source *event_loop_add_fd(int fd, uint32_t events,
+                                       event_callback callback, void *data) {
+    return add_source(EVENT_SOURCE_FD, fd, events, callback, data);
+}
+
+struct event_source *event_loop_add_timer(clockid_t clock,
+                                          event_callback callback, void *data) {
+    int fd = timerfd_create(clock, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        perror("timerfd_create");
+        exit(1);
+    }
+    struct event_source *source = add_source(EVENT_SOURCE_TIMER, fd, EPOLLIN, callback, data);
+    if (source == NULL) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    source->clock = clock;
+    return source;
+}
+
+static void dispatch_signals(void *data, uint32_t events) {
+    struct signalfd_siginfo info;
+    while (read(signal_source->fd, &info, sizeof(info)) == sizeof(info)) {
+        struct event_source *handler = signal_handlers[info.ssi_signo];
+        if (handler && !handler->removed) {
+            handler->wakeups++;
+            handler->callback(handler->data, info.ssi_signo);
+        }
+    }
+}
+
+struct event_source *event_loop_add_signal(int signo,
+                                           event_callback callback, void *data) {
+    sigaddset(&signal_mask, signo);
+    /* Threads started later, such as the renderer, inherit the mask. */
+    int err = pthread_sigmask(SIG_BLOCK, &signal_mask, NULL);
+    if (err != 0) {
+        errno = err;
+        perror("pthread_sigmask");
+        exit(1);
+    }
+
+    if (signal_source == NULL) {
+        int fd = signalfd(-1, &signal_mask, SFD_CLOEXEC | SFD_NONBLOCK);
+        if (fd < 0) {
+            perror("signalfd");
+            exit(1);
+        }
+        /* Not on the source list: wakeups are counted per signal instead. */
+        signal_source = new_source(EVENT_SOURCE_FD, fd, dispatch_signals, NULL);
+        if (!watch_fd(signal_source, EPOLLIN)) {
+            perror("epoll_ctl");
+            exit(1);
+        }
+    } else if (signalfd(signal_source->fd, &signal_mask, 0) < 0) {
+        perror("signalfd");
+        exit(1);
+    }
+
+    struct event_source *source = new_source(EVENT_SOURCE_SIGNAL, signo, callback, data);
+    source->next = sources;
+    sources = source;
+    signal_handlers[signo] = source;
+    return source;
+}
+
+void event_source_fd_update(struct event_source *source, uint32_t events) {
+    struct epoll_event ev = {.events = events, .data.ptr = source};
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, source->fd, &ev) < 0) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+}
+
+void event_source_timer_update(struct event_source *source,
+                               const struct timespec *value,
+                               const struct timespec *interval, int flags) {
+    struct itimerspec spec = {0};
+    if (value) {
+        spec.it_value = *value;
+    }
+    if (interval) {
+        spec.it_interval = *interval;
+    }
+    if (timerfd_settime(source->fd, flags, &spec, NULL) < 0) {
+        /*
+         * A clock change that cancelled the previous arm, unread, is reported
+         * here; the new arm is in place all the same.
+         */
+        if (errno != ECANCELED) {
+            perror("timerfd_settime");
+            exit(1);
+        }
+    }
+}
+
+void event_source_timer_update_ms(struct event_source *source, uint64_t ms) {
+    struct timespec value = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000,
+    };
+    event_source_timer_update(source, &value, NULL, 0);
+}
+
+void event_loop_set_frame_timing(const struct frame_timing *timing, clockid_t clock) {
+    frame_timing = *timing;
+    frame_timing_clock = clock;
+}
+
+static int64_t clock_now_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void event_source_timer_update_vblank(struct event_source *source, uint64_t when, int flags) {
+    if (frame_timing.refresh_ns) {
+        /* The prediction may be on another clock; their offset is taken now. */
+        int64_t offset = clock_now_ns(frame_timing_clock) - clock_now_ns(source->clock);
+        when = frame_timing_deadline(&frame_timing, when + offset) - offset;
+    }
+    struct timespec value = {when / 1000000000, when % 1000000000};
+    event_source_timer_update(source, &value, NULL, flags | TFD_TIMER_ABSTIME);
+}
+
+int event_source_get_fd(const struct event_source *source) {
+    return source->fd;
+}
+
+void event_source_set_name(struct event_source *source, const char *name) {
+    source->name = name;
+}
+
+void event_loop_for_each_source(void (*fn)(const char *name, uint64_t wakeups, void *data),
+                                void *data) {
+    for (struct event_source *source = sources; source; source = source->next) {
+        fn(source->name ? source->name : "unnamed", source->wakeups, data);
+    }
+}
+
+void event_source_remove(struct event_source *source) {
+    for (struct event_source **link = &sources; *link; link = &(*link)->next) {
+        if (*link == source) {
+            *link = source->next;
+            break;
+        }
+    }
+
+    if (source->type == EVENT_SOURCE_SIGNAL) {
+        signal_handlers[source->fd] = NULL;
+    } else {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, source->fd, NULL);
+        if (source->type == EVENT_SOURCE_TIMER) {
+            close(source->fd);
+        }
+    }
+
+    if (dispatching) {
+        source->removed = true;
+        source->next_removed = removed_sources;
+        removed_sources = source;
+    } else {
+        free(source);
+    }
+}
+
+static void dispatch_timer(struct event_source *source) {
+    uint64_t expirations;
+    ssize_t n = read(source->fd, &expirations, sizeof(expirations));
+    if (n == sizeof(expirations)) {
+        source->callback(source->data, EVENT_TIMER_EXPIRED);
+    } else if (n < 0 && errno == ECANCELED) {
+        source->callback(source->data, EVENT_TIMER_CANCELLED);
+    }
+}
+
+int event_loop_dispatch(int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    dispatching = true;
+    for (int i = 0; i < count; i++) {
+        struct event_source *source = events[i].data.ptr;
+        if (source->removed) {
+            continue;
+        }
+        if (source != signal_source) {
+            source->wakeups++;
+        }
+        if (source->type == EVENT_SOURCE_TIMER) {
+            dispatch_timer(source);
+        } else {
+            source->callback(source->data, events[i].events);
+        }
+    }
+    dispatching = false;
+
+    while (removed_sources) {
+        struct event_source *next = removed_sources->next_removed;
+        free(removed_sources);
+        removed_sources = next;
+    }
+    return count;
+}
+
+/* Frees whatever sources are left; timerfds are closed, other fds are not. */
+void event_loop_finish(void) {
+    while (sources) {
+        event_source_remove(sources);
+    }
+    while (removed_sources) {
+        struct event_source *next = removed_sources->next_removed;
+        free(removed_sources);
+        removed_sources = next;
+    }
+    if (signal_source) {
+        close(signal_source->fd);
+        free(signal_source);
+        signal_source = NULL;
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <time.h>
+
+/*
+ * A single epoll set that owns every wakeup source of the bar: the Wayland
+ * socket, timers (timerfd), signals (signalfd) and whatever file descriptors
+ * modules register. Callbacks run on the loop thread and must not block.
+ *
+ * The meaning of `events` depends on the kind of source:
+ *  - fd sources receive the epoll event mask (EPOLLIN, EPOLLOUT, ...);
+ *  - timer sources receive EVENT_TIMER_EXPIRED or EVENT_TIMER_CANCELLED;
+ *  - signal sources receive the signal number.
+ */
+#define EVENT_TIMER_EXPIRED (1u << 0)
+#define EVENT_TIMER_CANCELLED (1u << 1)
+
+struct frame_timing;
+
+typedef void (*event_callback)(void *data, uint32_t events);
+
+struct event_source;
+
+void event_loop_init(void);
+void event_loop_finish(void);
+
+/* Waits up to timeout_ms (-1 for ever) and runs the ready callbacks. */
+int event_loop_dispatch(int timeout_ms);
+
+/* NULL with errno set when epoll cannot watch fd (EPERM for regular files). */
+struct event_source *event_loop_add_fd(int fd, uint32_t events,
+                                       event_callback callback, void *data);
+struct event_source *event_loop_add_timer(clockid_t clock,
+                                          event_callback callback, void *data);
+struct event_source *event_loop_add_signal(int signo,
+                                           event_callback callback, void *data);
+
+void event_source_fd_update(struct event_source *source, uint32_t events);
+/* A zero value disarms the timer; flags are timerfd_settime() flags. */
+void event_source_timer_update(struct event_source *source,
+                               const struct timespec *value,
+                               const struct timespec *interval, int flags);
+void event_source_timer_update_ms(struct event_source *source, uint64_t ms);
+
+/*
+ * Vblank prediction of the output that presented last, with the clock its
+ * times are on. It is copied, so the caller's may go away.
+ */
+void event_loop_set_frame_timing(const struct frame_timing *timing, clockid_t clock);
+/*
+ * Arms a one-shot timer for the draw deadline of the first vblank at or
+ * after `when`, in ns on the timer's clock, so that what the callback
+ * changes is on screen at that vblank. Until a refresh rate is known it
+ * fires at `when` itself. flags are added to TFD_TIMER_ABSTIME.
+ */
+void event_source_timer_update_vblank(struct event_source *source, uint64_t when, int flags);
+int event_source_get_fd(const struct event_source *source);
+/* Names the source in wakeup statistics; the string must outlive it. */
+void event_source_set_name(struct event_source *source, const char *name);
+void event_source_remove(struct event_source *source);
+
+void event_loop_for_each_source(void (*fn)(const char *name, uint64_t wakeups, void *data),
+                                void *data);
+
+#endif
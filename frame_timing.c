@@ -0,0 +1,32 @@
+#include "frame_timing.h"
+
+void frame_timing_presented(struct frame_timing *timing, uint64_t present_ns,
+                            uint32_t refresh_ns) {
+    /* Feedback can arrive out of order across surfaces on one output. */
+    if (present_ns > timing->last_present_ns) {
+        timing->last_present_ns = present_ns;
+    }
+    /* Zero means variable refresh: keep the last fixed rate, if any. */
+    if (refresh_ns) {
+        timing->refresh_ns = refresh_ns;
+    }
+}
+
+uint64_t frame_timing_next_vblank(const struct frame_timing *timing, uint64_t when) {
+    if (timing->refresh_ns == 0 || timing->last_present_ns == 0) {
+        return when;
+    }
+    if (when <= timing->last_present_ns) {
+        return timing->last_present_ns;
+    }
+    uint64_t cycles = (when - timing->last_present_ns + timing->refresh_ns - 1) / timing->refresh_ns;
+    return timing->last_present_ns + cycles * timing->refresh_ns;
+}
+
+uint64_t frame_timing_deadline(const struct frame_timing *timing, uint64_t when) {
+    uint64_t vblank = frame_timing_next_vblank(timing, when);
+    if (timing->refresh_ns == 0 || vblank < timing->refresh_ns) {
+        return vblank;
+    }
+    return vblank - timing->refresh_ns;
+}
@@ -0,0 +1,27 @@
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+
+#include <stdint.h>
+
+/*
+ * Vblank prediction from wp_presentation feedback. Times are nanoseconds
+ * on the presentation clock. Until feedback with a usable refresh arrives,
+ * nothing is predicted and times pass through unchanged.
+ */
+struct frame_timing {
+    uint64_t last_present_ns;
+    uint32_t refresh_ns;
+};
+
+void frame_timing_presented(struct frame_timing *timing, uint64_t present_ns,
+                            uint32_t refresh_ns);
+/* The first predicted vblank at or after `when`. */
+uint64_t frame_timing_next_vblank(const struct frame_timing *timing, uint64_t when);
+/*
+ * When to draw so that the frame is on screen at the first vblank at or
+ * after `when`: one refresh before that vblank, which leaves the
+ * compositor a full cycle to pick the commit up.
+ */
+uint64_t frame_timing_deadline(const struct frame_timing *timing, uint64_t when);
+
+#endif
@@ -1 +1,8 @@
-gcc -o popup popup.c wlr-layer-shell-unstable-v1-protocol.c xdg-shell-protocol.c -lwayland-client -lfcft -lpixman-1 -lm -lwayland-egl -lEGL -lGLESv2 -lwayland-cursor 
+case "$1" in
+bench)
+gcc -O2 $(pkg-config --cflags pixman-1) -o bench bench.c atlas.c damage.c event_loop.c frame_timing.c module.c module_clock.c module_cpu.c module_load.c module_net.c module_power.c program_cache.c render.c scene.c stats.c -lfcft -lpixman-1 -lEGL -lGLESv2 -lm
+;;
+*)
+gcc -pthread $(pkg-config --cflags pixman-1) -o popup popup.c atlas.c backend_egl.c backend_shm.c damage.c event_loop.c frame_timing.c module.c module_clock.c module_cpu.c module_load.c module_net.c module_power.c program_cache.c render.c render_thread.c scene.c stats.c wlr-layer-shell-unstable-v1-protocol.c fractional-scale-v1-protocol.c presentation-time-protocol.c viewporter-protocol.c xdg-output-unstable-v1-protocol.c xdg-shell-protocol.c -lwayland-client -lfcft -lpixman-1 -lm -lwayland-egl -lEGL -lGLESv2 -lwayland-cursor 
+;;
+esac
@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include "event_loop.h"
+#include "module.h"
+#include "stats.h"
+
+#define MAX_TICKS 8
+
+struct tick {
+    uint32_t interval_ms;
+    struct event_source *timer;
+};
+
+static const struct module_type *const module_types[] = {
+    &clock_module,
+    &cpu_module,
+    &load_module,
+    &net_module,
+    &power_module,
+};
+
+static struct module modules[SCENE_MAX_BLOCKS];
+static int module_count;
+static struct tick ticks[MAX_TICKS];
+static int tick_count;
+static bool dirty;
+
+static const struct module_type *find_type(const char *name, size_t length) {
+    for (size_t i = 0; i < sizeof(module_types) / sizeof(module_types[0]); i++) {
+        const char *type_name = module_types[i]->name;
+        if (strlen(type_name) == length && strncmp(type_name, name, length) == 0) {
+            return module_types[i];
+        }
+    }
+    return NULL;
+}
+
+void module_update(struct module *module) {
+    uint64_t start = stats_now();
+    module->type->update(module);
+    uint64_t elapsed = stats_now() - start;
+    stats_record_ns(STATS_MODULE_UPDATE, elapsed);
+    module->updates++;
+    module->update_ns += elapsed;
+}
+
+static void handle_tick(void *data, uint32_t events) {
+    struct tick *tick = data;
+    /* A cancelled tick cannot happen on the monotonic clock; it just runs. */
+    for (int i = 0; i < module_count; i++) {
+        struct module *module = &modules[i];
+        if (module->type->interval_ms == tick->interval_ms) {
+            module_update(module);
+        }
+    }
+}
+
+/* The first expiry is the next multiple of the interval since boot. */
+static void arm_tick(struct tick *tick) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t interval_ns = (uint64_t)tick->interval_ms * 1000000;
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    uint64_t next_ns = (now_ns / interval_ns + 1) * interval_ns;
+    struct timespec value = {next_ns / 1000000000, next_ns % 1000000000};
+    struct timespec interval = {interval_ns / 1000000000, interval_ns % 1000000000};
+    event_source_timer_update(tick->timer, &value, &interval, TFD_TIMER_ABSTIME);
+}
+
+static void add_tick(uint32_t interval_ms) {
+    for (int i = 0; i < tick_count; i++) {
+        if (ticks[i].interval_ms == interval_ms) {
+            return;
+        }
+    }
+    if (tick_count == MAX_TICKS) {
+        fprintf(stderr, "Too many distinct module intervals\n");
+        exit(1);
+    }
+    struct tick *tick = &ticks[tick_count++];
+    tick->interval_ms = interval_ms;
+    tick->timer = event_loop_add_timer(CLOCK_MONOTONIC, handle_tick, tick);
+    event_source_set_name(tick->timer, "modules");
+    arm_tick(tick);
+}
+
+void modules_init(const char *names) {
+    const char *p = names;
+    while (*p) {
+        size_t length = strcspn(p, ",");
+        const struct module_type *type = find_type(p, length);
+        if (type == NULL) {
+            fprintf(stderr, "Unknown module %.*s\n", (int)length, p);
+            exit(1);
+        }
+        if (module_count == SCENE_MAX_BLOCKS) {
+            fprintf(stderr, "Too many modules\n");
+            exit(1);
+        }
+        struct module *module = &modules[module_count];
+        memset(module, 0, sizeof(*module));
+        module->type = type;
+        if (type->init == NULL || type->init(module)) {
+            module_count++;
+            if (type->interval_ms) {
+                add_tick(type->interval_ms);
+            }
+            /* Shows something right away instead of after the first tick. */
+            if (type->update) {
+                module_update(module);
+            }
+        } else {
+            fprintf(stderr, "Module %s is not available, leaving it out\n", type->name);
+        }
+        p += length;
+        if (*p == ',') {
+            p++;
+        }
+    }
+}
+
+void modules_finish(void) {
+    for (int i = 0; i < module_count; i++) {
+        if (modules[i].type->finish) {
+            modules[i].type->finish(&modules[i]);
+        }
+    }
+    for (int i = 0; i < tick_count; i++) {
+        event_source_remove(ticks[i].timer);
+    }
+    module_count = 0;
+    tick_count = 0;
+}
+
+void module_set_text(struct module *module, const char *text) {
+    if (strncmp(module->text, text, sizeof(module->text) - 1) == 0) {
+        return;
+    }
+    snprintf(module->text, sizeof(module->text), "%s", text);
+    module->dirty = true;
+    module->changes++;
+    dirty = true;
+}
+
+void module_printf(struct module *module, const char *format, ...) {
+    char text[BLOCK_TEXT_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    module_set_text(module, text);
+}
+
+bool modules_dirty(void) {
+    return dirty;
+}
+
+size_t modules_compose(char *out, size_t length, size_t size) {
+    for (int i = 0; i < module_count; i++) {
+        struct module *module = &modules[i];
+        module->dirty = false;
+        /* Nothing to show yet takes no space. */
+        if (module->text[0] == '\0') {
+            continue;
+        }
+        int n = snprintf(out + length, size - length, "%s%s",
+                         length > 0 ? "\t" : "", module->text);
+        if (n < 0 || (size_t)n >= size - length) {
+            break;
+        }
+        length += n;
+    }
+    dirty = false;
+    return length;
+}
+
+void modules_dump(FILE *out) {
+    for (int i = 0; i < module_count; i++) {
+        const struct module *module = &modules[i];
+        fprintf(out, "module %s updates %llu changes %llu update_us %.1f\n", module->type->name,
+                (unsigned long long)module->updates, (unsigned long long)module->changes,
+                module->updates ? module->update_ns / 1e3 / module->updates : 0.0);
+    }
+}
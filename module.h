@@ -0,0 +1,76 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "scene.h"
+
+/*
+ * A module produces one block of the bar from some piece of system state.
+ * It wakes either on its own event loop sources, registered in init(), or
+ * on a periodic tick, and hands its output over through module_set_text().
+ * The text is only taken, and the module only marked dirty, when it differs
+ * from what the block already shows, so a module that polls often but
+ * rarely changes costs no layout or drawing.
+ *
+ * Ticks are shared: modules with the same interval run from one timer,
+ * armed at multiples of the interval on the monotonic clock, so modules
+ * whose intervals divide each other also wake in the same loop iteration.
+ */
+struct module;
+
+struct module_type {
+    const char *name;
+    /* Milliseconds between update() calls; 0 when only its own sources wake it. */
+    uint32_t interval_ms;
+    /* Returns false when the module cannot run on this system; it is left out. */
+    bool (*init)(struct module *module);
+    void (*update)(struct module *module);
+    void (*finish)(struct module *module);
+};
+
+struct module {
+    const struct module_type *type;
+    void *data;
+    /* What the block shows; changed only through module_set_text(). */
+    char text[BLOCK_TEXT_MAX];
+    bool dirty;
+    uint64_t updates, changes;
+    uint64_t update_ns;
+};
+
+extern const struct module_type clock_module;
+extern const struct module_type cpu_module;
+extern const struct module_type load_module;
+extern const struct module_type net_module;
+extern const struct module_type power_module;
+
+/* What the cpu module reads at init; the benchmark points it at a generated file. */
+extern const char *cpu_stat_path;
+
+/*
+ * Starts the comma separated list of modules, in the order they are shown.
+ * Needs the event loop; exits on an unknown name.
+ */
+void modules_init(const char *names);
+void modules_finish(void);
+
+/* Runs update() and accounts for it; for modules woken by their own sources. */
+void module_update(struct module *module);
+void module_set_text(struct module *module, const char *text);
+__attribute__((format(printf, 2, 3)))
+void module_printf(struct module *module, const char *format, ...);
+
+/* True when some module changed since the last modules_compose(). */
+bool modules_dirty(void);
+/*
+ * Writes the blocks of every module with something to show to out, tab
+ * separated, after the length bytes already there, and clears the dirty
+ * flags. Returns the new length.
+ */
+size_t modules_compose(char *out, size_t length, size_t size);
+void modules_dump(FILE *out);
+
+#endif
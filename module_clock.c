@@ -0,0 +1,97 @@
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include "event_loop.h"
+#include "module.h"
+
+/*
+ * Wall clock. The text can only change when the time crosses a multiple
+ * of its resolution, a minute unless the format shows seconds, so a single
+ * absolute timerfd is armed for exactly that instant: a minute clock wakes
+ * 1440 times a day and formats the text once per wakeup. The timer is on
+ * CLOCK_REALTIME with TFD_TIMER_CANCEL_ON_SET, so setting the clock, which
+ * also happens on resume from suspend, wakes it to re-align at once.
+ *
+ * The timer is armed through event_source_timer_update_vblank(): once the
+ * refresh rate is known it fires at the draw deadline of the first vblank
+ * after the boundary, up to a refresh early, and the text for the coming
+ * slot is drawn then; it reaches the screen on that vblank rather than one
+ * later.
+ */
+#define CLOCK_FORMAT "%a %d %b %H:%M"
+
+static struct event_source *clock_timer;
+static time_t resolution;
+/* Multiples of the resolution that the shown text was formatted for and the timer is armed for. */
+static time_t shown_slot = -1, armed_slot = -1;
+
+/* Seconds between possible changes of the text; offsets from UTC are whole minutes. */
+static time_t format_resolution(const char *format) {
+    for (const char *p = strchr(format, '%'); p && p[1]; p = strchr(p + 2, '%')) {
+        char conversion = p[1] == 'E' || p[1] == 'O' ? p[2] : p[1];
+        if (conversion && strchr("STXcrs+", conversion)) {
+            return 1;
+        }
+    }
+    return 60;
+}
+
+static void update_clock(struct module *module) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    time_t slot = now.tv_sec / resolution;
+    /* Woken ahead of the boundary to be on time for its vblank. */
+    if (armed_slot > slot) {
+        slot = armed_slot;
+    }
+    if (slot != shown_slot) {
+        struct tm tm;
+        char text[BLOCK_TEXT_MAX];
+        time_t shown = slot * resolution;
+        localtime_r(&shown, &tm);
+        if (strftime(text, sizeof(text), CLOCK_FORMAT, &tm) == 0) {
+            text[0] = '\0';
+        }
+        module_set_text(module, text);
+        shown_slot = slot;
+    }
+    armed_slot = slot + 1;
+    event_source_timer_update_vblank(clock_timer, (uint64_t)armed_slot * resolution * 1000000000,
+                                     TFD_TIMER_CANCEL_ON_SET);
+}
+
+static void handle_clock(void *data, uint32_t events) {
+    /* A clock change may come with a time zone change. */
+    if (events & EVENT_TIMER_CANCELLED) {
+        tzset();
+        shown_slot = armed_slot = -1;
+    }
+    module_update(data);
+}
+
+/* One instance; there is one timer. */
+static bool init_clock(struct module *module) {
+    if (clock_timer) {
+        return false;
+    }
+    resolution = format_resolution(CLOCK_FORMAT);
+    tzset();
+    clock_timer = event_loop_add_timer(CLOCK_REALTIME, handle_clock, module);
+    event_source_set_name(clock_timer, "clock");
+    return true;
+}
+
+static void finish_clock(struct module *module) {
+    if (clock_timer) {
+        event_source_remove(clock_timer);
+        clock_timer = NULL;
+    }
+    shown_slot = armed_slot = -1;
+}
+
+const struct module_type clock_module = {
+    .name = "clock",
+    .init = init_clock,
+    .update = update_clock,
+    .finish = finish_clock,
+};
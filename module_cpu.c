@@ -0,0 +1,155 @@
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "module.h"
+
+/*
+ * CPU usage from /proc/stat. The file stays open and is re-read with
+ * pread() into a static buffer, and the cpu lines are parsed in place, so
+ * a tick allocates nothing and costs one syscall however many CPUs there
+ * are. Usage is the busy share of the jiffies that passed since the
+ * previous tick, per CPU and over all of them.
+ *
+ * The block shows the aggregate and, on machines with few enough CPUs to
+ * fit, one bar per CPU.
+ */
+#define MAX_CPUS 1024
+/* Room for MAX_CPUS lines of ten 20-digit fields; the rest of the file is cut. */
+#define STAT_BUFFER_SIZE (MAX_CPUS * 224)
+#define MAX_CPU_BARS 32
+
+const char *cpu_stat_path = "/proc/stat";
+
+struct cpu_times {
+    uint64_t busy, total;
+};
+
+static int stat_fd = -1;
+static char stat_buffer[STAT_BUFFER_SIZE + 1];
+static struct cpu_times previous[MAX_CPUS + 1];
+/* Percent busy; index 0 is the aggregate, CPU n is at n + 1. */
+static uint8_t usage[MAX_CPUS + 1];
+static int cpu_count;
+
+/*
+ * /proc/stat numbers are short; a plain loop beats word-at-a-time tricks
+ * on them, since most are done before a second word would be needed.
+ */
+static const char *scan_number(const char *p, uint64_t *out) {
+    uint64_t value = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+    }
+    *out = value;
+    return p;
+}
+
+/* Fields: user nice system idle iowait irq softirq steal; guest time is part of user. */
+static const char *scan_times(const char *p, struct cpu_times *times) {
+    uint64_t field[8] = {0};
+    for (int i = 0; i < 8 && *p == ' '; i++) {
+        while (*p == ' ') {
+            p++;
+        }
+        p = scan_number(p, &field[i]);
+    }
+    times->total = 0;
+    for (int i = 0; i < 8; i++) {
+        times->total += field[i];
+    }
+    times->busy = times->total - field[3] - field[4];
+    return p;
+}
+
+static uint8_t percent(const struct cpu_times *now, const struct cpu_times *before) {
+    uint64_t total = now->total - before->total;
+    uint64_t busy = now->busy - before->busy;
+    if (total == 0 || busy > total) {
+        return 0;
+    }
+    return (busy * 100 + total / 2) / total;
+}
+
+/* Returns false when the file could not be read. */
+static bool read_stat(void) {
+    ssize_t n = pread(stat_fd, stat_buffer, STAT_BUFFER_SIZE, 0);
+    if (n <= 0) {
+        return false;
+    }
+    /* Only complete lines are parsed. */
+    while (n > 0 && stat_buffer[n - 1] != '\n') {
+        n--;
+    }
+    stat_buffer[n] = '\0';
+
+    const char *p = stat_buffer;
+    cpu_count = 0;
+    while (p[0] == 'c' && p[1] == 'p' && p[2] == 'u') {
+        p += 3;
+        uint64_t index = 0;
+        if (*p != ' ') {
+            p = scan_number(p, &index);
+            index++;
+        }
+        struct cpu_times times;
+        p = scan_times(p, &times);
+        if (index <= MAX_CPUS) {
+            usage[index] = percent(&times, &previous[index]);
+            previous[index] = times;
+            if (index > (uint64_t)cpu_count) {
+                cpu_count = index;
+            }
+        }
+        p = memchr(p, '\n', stat_buffer + n - p);
+        if (p == NULL) {
+            break;
+        }
+        p++;
+    }
+    return true;
+}
+
+static bool init_cpu(struct module *module) {
+    /* The counters and the open file are shared; one instance only. */
+    if (stat_fd >= 0) {
+        return false;
+    }
+    stat_fd = open(cpu_stat_path, O_RDONLY | O_CLOEXEC);
+    return stat_fd >= 0;
+}
+
+static void update_cpu(struct module *module) {
+    if (!read_stat()) {
+        module_set_text(module, "cpu ?");
+        return;
+    }
+    static const char *const bars[] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    char text[BLOCK_TEXT_MAX];
+    int length = snprintf(text, sizeof(text), "cpu %3d%%", usage[0]);
+    if (cpu_count <= MAX_CPU_BARS) {
+        text[length++] = ' ';
+        for (int i = 1; i <= cpu_count; i++) {
+            const char *bar = bars[usage[i] * 7 / 100];
+            size_t size = strlen(bar);
+            memcpy(text + length, bar, size);
+            length += size;
+        }
+    }
+    text[length] = '\0';
+    module_set_text(module, text);
+}
+
+static void finish_cpu(struct module *module) {
+    if (stat_fd >= 0) {
+        close(stat_fd);
+        stat_fd = -1;
+    }
+}
+
+const struct module_type cpu_module = {
+    .name = "cpu",
+    .interval_ms = 2000,
+    .init = init_cpu,
+    .update = update_cpu,
+    .finish = finish_cpu,
+};
@@ -0,0 +1,49 @@
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "module.h"
+
+/*
+ * Load average. The kernel recomputes it every five seconds, so polling
+ * faster would only read the same numbers again.
+ */
+static int load_fd = -1;
+
+/* Instances share the file. */
+static bool init_load(struct module *module) {
+    if (load_fd >= 0) {
+        return true;
+    }
+    load_fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    return load_fd >= 0;
+}
+
+static void update_load(struct module *module) {
+    char buffer[128];
+    ssize_t n = pread(load_fd, buffer, sizeof(buffer) - 1, 0);
+    if (n <= 0) {
+        module_set_text(module, "load ?");
+        return;
+    }
+    buffer[n] = '\0';
+    char *end;
+    double one = strtod(buffer, &end);
+    double five = strtod(end, &end);
+    double fifteen = strtod(end, &end);
+    module_printf(module, "load %.2f %.2f %.2f", one, five, fifteen);
+}
+
+static void finish_load(struct module *module) {
+    if (load_fd >= 0) {
+        close(load_fd);
+        load_fd = -1;
+    }
+}
+
+const struct module_type load_module = {
+    .name = "load",
+    .interval_ms = 5000,
+    .init = init_load,
+    .update = update_load,
+    .finish = finish_load,
+};
@@ -0,0 +1,472 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "module.h"
+
+/*
+ * Network state and throughput from rtnetlink. Link and address changes
+ * arrive on a socket subscribed to the link and IPv4 address groups, so
+ * up/down shows without waiting for a tick. Byte counters come from one
+ * RTM_GETLINK dump per tick on a second socket, read from IFLA_STATS64 as
+ * the replies arrive; rates are computed once the dump is done.
+ *
+ * When the event socket overruns, events are lost. The next link dump is
+ * then a full snapshot: links it does not report are dropped, and the
+ * addresses are dumped again.
+ *
+ * Links that are up and running, not loopback, not enslaved to a bridge or
+ * bond and not a veth or bridge themselves are shown: one by name and
+ * address, several as their summed rates. Hosts with hundreds of container
+ * veths only pay for them in the dump, never in text parsing.
+ */
+#define LINK_SLOTS 1024 /* power of two */
+#define RECEIVE_BUFFER_SIZE 65536
+/* Ticks a dump may stay unanswered before it is requested again. */
+#define DUMP_TIMEOUT_TICKS 3
+
+struct link {
+    int index; /* 0 for an empty slot */
+    unsigned flags;
+    bool ignored;
+    char name[IFNAMSIZ];
+    struct in_addr address;
+    /* Resync state: reported by the current link and address dumps. */
+    bool seen, address_seen;
+    struct in_addr dumped_address;
+    uint64_t rx_bytes, tx_bytes;
+    /* Counters at the previous completed dump, for rates. */
+    uint64_t last_rx_bytes, last_tx_bytes;
+    bool counted;
+    uint64_t rx_rate, tx_rate;
+};
+
+static struct module *instance;
+static int event_fd = -1, dump_fd = -1;
+static struct event_source *event_source, *dump_source;
+static uint32_t dump_seq, address_seq;
+static bool dump_pending, resync;
+static int dump_waited;
+static uint64_t last_dump_ns;
+static struct link links[LINK_SLOTS];
+static char receive_buffer[RECEIVE_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+
+/* Linear probing on the interface index. */
+static struct link *find_link(int index, bool create) {
+    for (unsigned i = 0; i < LINK_SLOTS; i++) {
+        struct link *link = &links[(index + i) & (LINK_SLOTS - 1)];
+        if (link->index == index) {
+            return link;
+        } else if (link->index == 0) {
+            if (!create) {
+                return NULL;
+            }
+            memset(link, 0, sizeof(*link));
+            link->index = index;
+            return link;
+        }
+    }
+    return NULL;
+}
+
+/* Shifts later entries of the probe sequence back, so no tombstones are needed. */
+static void remove_link(struct link *link) {
+    unsigned hole = link - links;
+    link->index = 0;
+    for (unsigned i = (hole + 1) & (LINK_SLOTS - 1); links[i].index; i = (i + 1) & (LINK_SLOTS - 1)) {
+        unsigned home = links[i].index & (LINK_SLOTS - 1);
+        /* Moves it unless its home lies cyclically in (hole, i]. */
+        if ((i > hole && (home <= hole || home > i)) || (i < hole && home <= hole && home > i)) {
+            links[hole] = links[i];
+            links[i].index = 0;
+            hole = i;
+        }
+    }
+}
+
+static bool shown(const struct link *link) {
+    return link->index && !link->ignored && (link->flags & IFF_UP) &&
+           (link->flags & IFF_RUNNING) && !(link->flags & IFF_LOOPBACK);
+}
+
+static void format_rate(char *out, size_t size, uint64_t rate) {
+    static const char units[] = "BKMGT";
+    double value = rate;
+    int unit = 0;
+    while (value >= 1000 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+    snprintf(out, size, unit ? "%.1f%c" : "%.0f%c", value, units[unit]);
+}
+
+static void show(void) {
+    const struct link *first = NULL;
+    int count = 0;
+    uint64_t rx = 0, tx = 0;
+    for (int i = 0; i < LINK_SLOTS; i++) {
+        if (shown(&links[i])) {
+            if (first == NULL || links[i].index < first->index) {
+                first = &links[i];
+            }
+            count++;
+            rx += links[i].rx_rate;
+            tx += links[i].tx_rate;
+        }
+    }
+    if (count == 0) {
+        module_set_text(instance, "net down");
+        return;
+    }
+    char down[16], up[16];
+    format_rate(down, sizeof(down), rx);
+    format_rate(up, sizeof(up), tx);
+    if (count > 1) {
+        module_printf(instance, "net ↓%s ↑%s", down, up);
+    } else if (first->address.s_addr) {
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &first->address, address, sizeof(address));
+        module_printf(instance, "%s %s ↓%s ↑%s", first->name, address, down, up);
+    } else {
+        module_printf(instance, "%s ↓%s ↑%s", first->name, down, up);
+    }
+}
+
+static void parse_link_info(struct link *link, struct rtattr *info) {
+    int length = RTA_PAYLOAD(info);
+    for (struct rtattr *attr = RTA_DATA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        if (attr->rta_type == IFLA_INFO_KIND) {
+            const char *kind = RTA_DATA(attr);
+            if (strcmp(kind, "veth") == 0 || strcmp(kind, "bridge") == 0) {
+                link->ignored = true;
+            }
+        }
+    }
+}
+
+/* Counters only come from dump replies, so that a rate spans one tick. */
+static void handle_link(struct nlmsghdr *header, bool dumped) {
+    struct ifinfomsg *info = NLMSG_DATA(header);
+    struct link *link = find_link(info->ifi_index, header->nlmsg_type == RTM_NEWLINK);
+    if (link == NULL) {
+        return;
+    }
+    if (header->nlmsg_type == RTM_DELLINK) {
+        remove_link(link);
+        return;
+    }
+    link->flags = info->ifi_flags;
+    link->ignored = false;
+    link->seen = true;
+    int length = IFLA_PAYLOAD(header);
+    for (struct rtattr *attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        switch (attr->rta_type) {
+        case IFLA_IFNAME:
+            snprintf(link->name, sizeof(link->name), "%s", (const char *)RTA_DATA(attr));
+            break;
+        case IFLA_MASTER:
+            link->ignored = true;
+            break;
+        case IFLA_LINKINFO:
+            parse_link_info(link, attr);
+            break;
+        case IFLA_STATS64: {
+            /* Older kernels send a shorter struct; the missing fields stay zero. */
+            struct rtnl_link_stats64 stats = {0};
+            size_t size = RTA_PAYLOAD(attr) < sizeof(stats) ? RTA_PAYLOAD(attr) : sizeof(stats);
+            memcpy(&stats, RTA_DATA(attr), size);
+            if (dumped) {
+                link->rx_bytes = stats.rx_bytes;
+                link->tx_bytes = stats.tx_bytes;
+            }
+            break;
+        }
+        }
+    }
+}
+
+/*
+ * Remembers the first global IPv4 address of a link. Replies to an address
+ * dump are set aside until it is done, see finish_address_dump().
+ */
+static void handle_address(struct nlmsghdr *header) {
+    struct ifaddrmsg *info = NLMSG_DATA(header);
+    if (info->ifa_family != AF_INET || info->ifa_scope != RT_SCOPE_UNIVERSE) {
+        return;
+    }
+    struct link *link = find_link(info->ifa_index, false);
+    if (link == NULL) {
+        return;
+    }
+    int length = IFA_PAYLOAD(header);
+    for (struct rtattr *attr = IFA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+        if (attr->rta_type != IFA_LOCAL) {
+            continue;
+        }
+        struct in_addr address;
+        memcpy(&address, RTA_DATA(attr), sizeof(address));
+        if (header->nlmsg_type == RTM_DELADDR) {
+            if (link->address.s_addr == address.s_addr) {
+                link->address.s_addr = 0;
+            }
+            if (link->dumped_address.s_addr == address.s_addr) {
+                link->dumped_address.s_addr = 0;
+            }
+        } else if (header->nlmsg_seq == 0) {
+            if (link->address.s_addr == 0) {
+                link->address = address;
+            }
+            link->address_seen |= link->address.s_addr == address.s_addr;
+        } else if (link->address.s_addr == address.s_addr) {
+            link->address_seen = true;
+        } else if (link->dumped_address.s_addr == 0) {
+            link->dumped_address = address;
+        }
+    }
+}
+
+/* A dump request carries the header of the objects it asks for. */
+static bool request_dump(int fd, uint16_t type, uint32_t seq) {
+    struct {
+        struct nlmsghdr header;
+        union {
+            struct ifinfomsg link;
+            struct ifaddrmsg address;
+        } body;
+    } request = {
+        .header = {
+            .nlmsg_type = type,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = seq,
+        },
+    };
+    if (type == RTM_GETADDR) {
+        request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body.address));
+        request.body.address.ifa_family = AF_INET;
+    } else {
+        request.header.nlmsg_len = NLMSG_LENGTH(sizeof(request.body.link));
+        request.body.link.ifi_family = AF_UNSPEC;
+    }
+    return send(fd, &request, request.header.nlmsg_len, 0) == (ssize_t)request.header.nlmsg_len;
+}
+
+static void start_dump(void) {
+    if (resync) {
+        for (int i = 0; i < LINK_SLOTS; i++) {
+            links[i].seen = false;
+        }
+    }
+    dump_waited = 0;
+    dump_pending = request_dump(dump_fd, RTM_GETLINK, ++dump_seq);
+}
+
+static bool request_addresses(void) {
+    for (int i = 0; i < LINK_SLOTS; i++) {
+        links[i].address_seen = false;
+        links[i].dumped_address.s_addr = 0;
+    }
+    return request_dump(event_fd, RTM_GETADDR, ++address_seq);
+}
+
+/* Keeps the shown address if the dump still reports it, else its first. */
+static void finish_address_dump(void) {
+    for (int i = 0; i < LINK_SLOTS; i++) {
+        struct link *link = &links[i];
+        if (link->index && (!link->address_seen || link->address.s_addr == 0)) {
+            link->address = link->dumped_address;
+        }
+    }
+}
+
+/* Drops the links that a dump started after lost events did not report. */
+static void prune_links(void) {
+    for (int i = 0; i < LINK_SLOTS;) {
+        /* Removal may move a later entry into this slot. */
+        if (links[i].index && !links[i].seen) {
+            remove_link(&links[i]);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void finish_dump(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    uint64_t elapsed = now_ns - last_dump_ns;
+    if (resync) {
+        prune_links();
+    }
+    for (int i = 0; i < LINK_SLOTS; i++) {
+        struct link *link = &links[i];
+        if (link->index == 0) {
+            continue;
+        }
+        /* Counters that went backwards belong to a re-created device. */
+        if (link->counted && elapsed > 0 && link->rx_bytes >= link->last_rx_bytes &&
+            link->tx_bytes >= link->last_tx_bytes) {
+            link->rx_rate = (link->rx_bytes - link->last_rx_bytes) * 1000000000 / elapsed;
+            link->tx_rate = (link->tx_bytes - link->last_tx_bytes) * 1000000000 / elapsed;
+        } else {
+            link->rx_rate = link->tx_rate = 0;
+        }
+        link->last_rx_bytes = link->rx_bytes;
+        link->last_tx_bytes = link->tx_bytes;
+        link->counted = true;
+    }
+    last_dump_ns = now_ns;
+    dump_pending = false;
+    /*
+     * Addresses are dumped once the links they belong to are known, at
+     * start and after lost events; otherwise events keep them current.
+     */
+    if (resync && request_addresses()) {
+        resync = false;
+    }
+}
+
+/* Returns false once the socket is broken. */
+static bool receive(int fd) {
+    for (;;) {
+        ssize_t n = recv(fd, receive_buffer, sizeof(receive_buffer), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /*
+             * ENOBUFS: messages were lost. A dump that lost some of its
+             * replies is given up, so that the rest are ignored; lost
+             * events make a new dump resync every link and address.
+             */
+            if (errno == ENOBUFS && fd == dump_fd) {
+                dump_pending = false;
+                dump_seq++;
+            } else if (errno == ENOBUFS) {
+                address_seq++;
+                resync = true;
+                start_dump();
+            }
+            return errno == EAGAIN || errno == ENOBUFS;
+        }
+        int length = n;
+        for (struct nlmsghdr *header = (struct nlmsghdr *)receive_buffer; NLMSG_OK(header, length);
+             header = NLMSG_NEXT(header, length)) {
+            /* Replies to a dump given up on are older than what followed. */
+            if (header->nlmsg_seq && header->nlmsg_seq != (fd == dump_fd ? dump_seq : address_seq)) {
+                continue;
+            }
+            switch (header->nlmsg_type) {
+            case RTM_NEWLINK:
+            case RTM_DELLINK:
+                handle_link(header, fd == dump_fd);
+                break;
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                handle_address(header);
+                break;
+            case NLMSG_DONE:
+            case NLMSG_ERROR:
+                if (fd == dump_fd) {
+                    finish_dump();
+                } else if (header->nlmsg_seq) {
+                    finish_address_dump();
+                }
+                break;
+            }
+        }
+    }
+}
+
+static void handle_netlink(void *data, uint32_t events) {
+    int fd = *(int *)data;
+    if (!receive(fd)) {
+        module_set_text(instance, "net ?");
+        return;
+    }
+    /* Dump replies only count once complete, or rates would mix two ticks. */
+    if (fd == event_fd || !dump_pending) {
+        show();
+    }
+}
+
+static int open_socket(uint32_t groups) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_nl addr = {.nl_family = AF_NETLINK, .nl_groups = groups};
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void finish_net(struct module *module) {
+    if (event_source) {
+        event_source_remove(event_source);
+        event_source = NULL;
+    }
+    if (dump_source) {
+        event_source_remove(dump_source);
+        dump_source = NULL;
+    }
+    if (event_fd >= 0) {
+        close(event_fd);
+        event_fd = -1;
+    }
+    if (dump_fd >= 0) {
+        close(dump_fd);
+        dump_fd = -1;
+    }
+    instance = NULL;
+    dump_pending = false;
+}
+
+/* One instance; its state is shared by both sockets. */
+static bool init_net(struct module *module) {
+    if (instance) {
+        return false;
+    }
+    instance = module;
+    /* The first dump learns every link and then asks for the addresses. */
+    resync = true;
+    event_fd = open_socket(RTMGRP_LINK | RTMGRP_IPV4_IFADDR);
+    dump_fd = open_socket(0);
+    if (event_fd < 0 || dump_fd < 0) {
+        finish_net(module);
+        return false;
+    }
+    event_source = event_loop_add_fd(event_fd, EPOLLIN, handle_netlink, &event_fd);
+    dump_source = event_loop_add_fd(dump_fd, EPOLLIN, handle_netlink, &dump_fd);
+    if (event_source == NULL || dump_source == NULL) {
+        finish_net(module);
+        return false;
+    }
+    event_source_set_name(event_source, "netlink");
+    event_source_set_name(dump_source, "netlink dump");
+    return true;
+}
+
+static void update_net(struct module *module) {
+    if (dump_pending && ++dump_waited < DUMP_TIMEOUT_TICKS) {
+        return;
+    }
+    start_dump();
+}
+
+const struct module_type net_module = {
+    .name = "net",
+    .interval_ms = 2000,
+    .init = init_net,
+    .update = update_net,
+    .finish = finish_net,
+};
@@ -0,0 +1,271 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/netlink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "event_loop.h"
+#include "module.h"
+
+/*
+ * Batteries and external power from /sys/class/power_supply, without a
+ * timer: the kernel announces every change of a supply with a uevent, and
+ * only the supply named in it is read again. Attribute files stay open and
+ * are re-read with pread(), which makes sysfs produce the value afresh.
+ * How often a battery's capacity changes is up to its driver and firmware.
+ *
+ * Supplies are found once at start and again whenever one is added or
+ * removed. Those with scope Device power a peripheral, such as a mouse or
+ * a headset, and not the machine, so they are left out. Chargers show up
+ * as Mains, or as USB for USB and USB-C ports; both count as "ac".
+ */
+#define POWER_SUPPLY_DIR "/sys/class/power_supply"
+#define MAX_SUPPLIES 8
+#define UEVENT_BUFFER_SIZE 8192
+
+enum supply_type {
+    SUPPLY_BATTERY,
+    SUPPLY_MAINS,
+};
+
+struct supply {
+    char name[NAME_MAX + 1];
+    enum supply_type type;
+    /* capacity and status for batteries, online for mains and USB; -1 when missing. */
+    int value_fd, status_fd;
+    int capacity;
+    bool online;
+    char status[16];
+};
+
+static struct module *instance;
+static int uevent_fd = -1;
+static struct event_source *uevent_source;
+static struct supply supplies[MAX_SUPPLIES];
+static int supply_count;
+static char uevent_buffer[UEVENT_BUFFER_SIZE + 1];
+
+/* Returns the length read, without the trailing newline, or -1. */
+static int read_attribute(int fd, char *out, size_t size) {
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t n = pread(fd, out, size - 1, 0);
+    if (n < 0) {
+        return -1;
+    }
+    while (n > 0 && out[n - 1] == '\n') {
+        n--;
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static void read_supply(struct supply *supply) {
+    char value[32];
+    if (supply->type == SUPPLY_MAINS) {
+        supply->online = read_attribute(supply->value_fd, value, sizeof(value)) > 0 &&
+                         value[0] == '1';
+        return;
+    }
+    supply->capacity = read_attribute(supply->value_fd, value, sizeof(value)) > 0 ?
+                       atoi(value) : -1;
+    if (read_attribute(supply->status_fd, supply->status, sizeof(supply->status)) < 0) {
+        supply->status[0] = '\0';
+    }
+}
+
+/* Reads the attribute `name` of the supply directory `dir` once. */
+static int read_attribute_at(int dir, const char *name, char *out, size_t size) {
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    int length = read_attribute(fd, out, size);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return length;
+}
+
+static void close_supplies(void) {
+    for (int i = 0; i < supply_count; i++) {
+        if (supplies[i].value_fd >= 0) {
+            close(supplies[i].value_fd);
+        }
+        if (supplies[i].status_fd >= 0) {
+            close(supplies[i].status_fd);
+        }
+    }
+    supply_count = 0;
+}
+
+static void scan_supplies(void) {
+    close_supplies();
+    DIR *dir = opendir(POWER_SUPPLY_DIR);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) && supply_count < MAX_SUPPLIES) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        int supply_dir = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (supply_dir < 0) {
+            continue;
+        }
+        char type[32], scope[16];
+        int length = read_attribute_at(supply_dir, "type", type, sizeof(type));
+        if (read_attribute_at(supply_dir, "scope", scope, sizeof(scope)) > 0 &&
+            strcmp(scope, "Device") == 0) {
+            length = -1;
+        }
+
+        struct supply *supply = &supplies[supply_count];
+        memset(supply, 0, sizeof(*supply));
+        supply->value_fd = supply->status_fd = -1;
+        snprintf(supply->name, sizeof(supply->name), "%s", entry->d_name);
+        if (length > 0 && strcmp(type, "Battery") == 0) {
+            supply->type = SUPPLY_BATTERY;
+            supply->value_fd = openat(supply_dir, "capacity", O_RDONLY | O_CLOEXEC);
+            supply->status_fd = openat(supply_dir, "status", O_RDONLY | O_CLOEXEC);
+            supply_count++;
+        } else if (length > 0 && (strcmp(type, "Mains") == 0 || strcmp(type, "USB") == 0)) {
+            supply->type = SUPPLY_MAINS;
+            supply->value_fd = openat(supply_dir, "online", O_RDONLY | O_CLOEXEC);
+            supply_count++;
+        }
+        close(supply_dir);
+    }
+    closedir(dir);
+    for (int i = 0; i < supply_count; i++) {
+        read_supply(&supplies[i]);
+    }
+}
+
+static void show(void) {
+    int batteries = 0, capacity = 0;
+    bool online = false;
+    const char *status = "";
+    for (int i = 0; i < supply_count; i++) {
+        const struct supply *supply = &supplies[i];
+        if (supply->type == SUPPLY_MAINS) {
+            online |= supply->online;
+        } else if (supply->capacity >= 0) {
+            batteries++;
+            capacity += supply->capacity;
+            /* Charging or discharging says more than another battery being full. */
+            if (status[0] == '\0' || strcmp(status, "Full") == 0 ||
+                strcmp(status, "Not charging") == 0) {
+                status = supply->status;
+            }
+        }
+    }
+    if (batteries == 0) {
+        module_set_text(instance, online ? "ac" : "");
+        return;
+    }
+    const char *sign = strcmp(status, "Charging") == 0 ? " +" :
+                       strcmp(status, "Discharging") == 0 ? " -" : "";
+    module_printf(instance, "bat %d%%%s", capacity / batteries, sign);
+}
+
+/*
+ * A kernel uevent is "action@devpath" followed by KEY=value strings, all
+ * NUL-terminated.
+ */
+static void handle_uevent(const char *message, size_t length) {
+    const char *action = message;
+    const char *devpath = NULL;
+    bool power_supply = false;
+    for (const char *p = message + strlen(message) + 1; p < message + length; p += strlen(p) + 1) {
+        if (strncmp(p, "DEVPATH=", 8) == 0) {
+            devpath = p + 8;
+        } else if (strcmp(p, "SUBSYSTEM=power_supply") == 0) {
+            power_supply = true;
+        }
+    }
+    if (!power_supply || devpath == NULL) {
+        return;
+    }
+    if (strncmp(action, "change@", 7) != 0) {
+        scan_supplies();
+        return;
+    }
+    const char *name = strrchr(devpath, '/');
+    name = name ? name + 1 : devpath;
+    for (int i = 0; i < supply_count; i++) {
+        if (strcmp(supplies[i].name, name) == 0) {
+            read_supply(&supplies[i]);
+            return;
+        }
+    }
+}
+
+static void handle_uevent_socket(void *data, uint32_t events) {
+    for (;;) {
+        ssize_t n = recv(uevent_fd, uevent_buffer, UEVENT_BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* Lost events leave any supply possibly stale. */
+            if (errno == ENOBUFS) {
+                scan_supplies();
+                continue;
+            }
+            break;
+        }
+        uevent_buffer[n] = '\0';
+        handle_uevent(uevent_buffer, n);
+    }
+    show();
+}
+
+static void finish_power(struct module *module) {
+    if (uevent_source) {
+        event_source_remove(uevent_source);
+        uevent_source = NULL;
+    }
+    if (uevent_fd >= 0) {
+        close(uevent_fd);
+        uevent_fd = -1;
+    }
+    close_supplies();
+    instance = NULL;
+}
+
+/* One instance; the socket and supplies are shared state. */
+static bool init_power(struct module *module) {
+    if (instance) {
+        return false;
+    }
+    scan_supplies();
+    if (supply_count == 0) {
+        return false;
+    }
+    uevent_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       NETLINK_KOBJECT_UEVENT);
+    /* Group 1 carries the kernel's own events; udev rebroadcasts on others. */
+    struct sockaddr_nl addr = {.nl_family = AF_NETLINK, .nl_groups = 1};
+    if (uevent_fd < 0 || bind(uevent_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        finish_power(module);
+        return false;
+    }
+    instance = module;
+    uevent_source = event_loop_add_fd(uevent_fd, EPOLLIN, handle_uevent_socket, NULL);
+    if (uevent_source == NULL) {
+        finish_power(module);
+        return false;
+    }
+    event_source_set_name(uevent_source, "uevent");
+    show();
+    return true;
+}
+
+const struct module_type power_module = {
+    .name = "power",
+    .init = init_power,
+    .finish = finish_power,
+};
@@ -1,116 +1,651 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcft/fcft.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
+#include "fractional-scale-v1-client-protocol.h"
+#include "presentation-time-client-protocol.h"
+#include "viewporter-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
-#include <wayland-egl.h>
-#include <EGL/egl.h>
-#include <GLES2/gl2.h>
+#include "xdg-output-unstable-v1-client-protocol.h"
+#include "atlas.h"
+#include "backend.h"
+#include "damage.h"
+#include "event_loop.h"
+#include "frame_timing.h"
+#include "module.h"
+#include "render_thread.h"
+#include "scene.h"
+#include "stats.h"
 
 static struct wl_display *display;
 static struct wl_compositor *compositor;
 static struct zwlr_layer_shell_v1 *layer_shell;
-static struct wl_surface *surface;
-static struct zwlr_layer_surface_v1 *layer_surface;
-static uint32_t width = 256, height = 256;
-static struct wl_egl_window *egl_window;
-static EGLDisplay egl_display;
-static EGLContext egl_context;
-static EGLSurface egl_surface;
-static EGLConfig config;
-
-static void check_egl_error(const char *msg) {
-    EGLint error = eglGetError();
-    if (error != EGL_SUCCESS) {
-        fprintf(stderr, "%s: EGL error 0x%x\n", msg, error);
-        exit(1);
+static struct zxdg_output_manager_v1 *xdg_output_manager;
+static struct wp_viewporter *viewporter;
+static struct wl_subcompositor *subcompositor;
+static struct wp_presentation *presentation;
+static clockid_t presentation_clock = CLOCK_MONOTONIC;
+static bool use_subsurfaces;
+static struct wp_fractional_scale_manager_v1 *fractional_scale_manager;
+static struct wl_shm *shm;
+static uint32_t bar_height;
+static const struct backend *backend = &egl_backend;
+static bool use_render_thread;
+
+/*
+ * Non-blocking mode swaps with an interval of 0, so the swap itself never
+ * waits for the compositor. Frames are paced by frame callbacks alone, and
+ * a frame is only drawn while fewer than MAX_FRAMES_IN_FLIGHT commits await
+ * their presentation feedback: one on screen and one queued, which leaves
+ * EGL a free buffer to draw into. A hidden output sends neither callbacks
+ * nor feedback, so its bar just stops drawing. Without wp_presentation
+ * only the frame callbacks are left to pace.
+ */
+#define MAX_FRAMES_IN_FLIGHT 2
+static bool nonblocking;
+
+/*
+ * Once nothing has been drawn for this long, the backend may drop what it
+ * can rebuild, such as glyphs that went off screen.
+ */
+#define IDLE_TRIM_MS 10000
+static struct event_source *idle_timer;
+static bool drew_frame;
+
+static bool running = true;
+static struct event_source *display_source;
+static bool display_read;
+static bool display_wants_write;
+static const char *stats_socket_path;
+static int stats_socket = -1;
+
+static const char *font_name = "monospace:size=10";
+static struct fcft_font *font;
+/* In surface-local pixels; scaled along with the font. */
+static struct block_style block_style = {.border_color = 0xff555555};
+
+/*
+ * Scales are in 120ths, as wp_fractional_scale_v1 reports them. Each scale
+ * gets its own font, loaded on first use and kept; the glyph atlas is keyed
+ * by font, so a bar moving back to a scale seen before finds its glyphs
+ * already rasterized.
+ */
+#define MAX_SCALES 8
+#define SCALE_ONE 120
+
+static struct {
+    uint32_t scale;
+    struct fcft_font *font;
+} scaled_fonts[MAX_SCALES];
+static int scaled_font_count;
+
+/*
+ * Startup work that does not need the compositor's answers runs on threads
+ * while the main thread waits on round-trips: the font loads during the
+ * registry round-trip, the backend (EGL display and context) initializes
+ * during the configure round-trip. Each is joined right before first use.
+ */
+static pthread_t font_thread, backend_thread;
+static bool font_pending, backend_pending;
+
+/*
+ * The status is read from stdin, one line per update; tabs separate blocks.
+ * Only the last complete line of a read matters. The bar shows its blocks
+ * followed by one block per module.
+ */
+static struct event_source *stdin_source;
+static char stdin_buffer[4096];
+static size_t stdin_length;
+static char input_status[sizeof(stdin_buffer)];
+static char status[sizeof(stdin_buffer) + SCENE_MAX_BLOCKS * BLOCK_TEXT_MAX];
+static const char *module_names = "";
+
+/*
+ * A wl_surface that shows part of a scene: the bar itself or, in subsurface
+ * mode, a single block. Render scheduling: a frame is only drawn when
+ * something marked the surface dirty, and never while the previous frame's
+ * wl_surface.frame callback is still outstanding. At most one frame is in
+ * flight per surface.
+ */
+struct bar_surface {
+    struct wl_surface *surface;
+    struct wl_subsurface *subsurface;
+    struct wp_viewport *viewport;
+    struct render_target *target;
+    const struct scene *scene;
+    /* The part of the scene shown, in buffer pixels. */
+    struct rect area;
+    /* Fed by presentation feedback; shared by all surfaces of a bar. */
+    struct frame_timing *timing;
+    uint64_t last_present;
+    /* Commits still waiting for presented or discarded. */
+    int frames_in_flight;
+
+    bool dirty;
+    struct wl_callback *frame_callback;
+    uint64_t frame_done_time;
+    /* Damage accumulated since the last frame, relative to the area. */
+    struct damage pending_damage;
+};
+
+/*
+ * One bar per wl_output. All bars share the fonts, the backend (and with it
+ * the EGL context, shaders and glyph atlas) and the status; each has its
+ * own surfaces, layout and frame scheduling.
+ */
+struct bar {
+    struct wl_list link;
+    uint32_t global_name;
+    struct wl_output *output;
+    struct zxdg_output_v1 *xdg_output;
+    char *name;
+    int32_t output_x, output_y, output_width, output_height;
+    int32_t output_scale;
+
+    struct bar_surface main;
+    struct zwlr_layer_surface_v1 *layer_surface;
+    struct wp_fractional_scale_v1 *fractional_scale;
+    uint32_t preferred_scale;
+    /* Surface-local size from configure. */
+    uint32_t surface_width, surface_height;
+    /* Applied scale and the buffer size in device pixels it implies. */
+    uint32_t scale;
+    uint32_t width, height;
+    struct scene scene;
+    struct frame_timing timing;
+
+    /*
+     * Subsurface mode: the bar's own surface only shows the backdrop and
+     * every block sits on top in a desynchronized subsurface of its own, so
+     * a changing block commits nothing but its own small buffer.
+     */
+    struct scene backdrop;
+    struct bar_surface blocks[SCENE_MAX_BLOCKS];
+    int block_count;
+};
+
+static struct wl_list bars;
+/* Set once the font is loaded; bars for outputs seen earlier wait for it. */
+static bool bars_ready;
+
+static void frame_done(void *data, struct wl_callback *callback, uint32_t time) {
+    struct bar_surface *surface = data;
+    wl_callback_destroy(callback);
+    surface->frame_callback = NULL;
+    stats_milestone(STATS_FIRST_FRAME);
+    if (surface->dirty) {
+        surface->frame_done_time = stats_now();
     }
 }
 
-static void init_egl(void) {
-    EGLint major, minor;
-    egl_display = eglGetDisplay((EGLNativeDisplayType)display);
-    if (egl_display == EGL_NO_DISPLAY) {
-        fprintf(stderr, "Can't create egl display\n");
-        exit(1);
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+/*
+ * Outstanding wp_presentation_feedback objects. A commit without a free
+ * slot simply goes without feedback.
+ */
+#define MAX_FEEDBACK 64
+
+struct feedback {
+    struct wp_presentation_feedback *feedback;
+    struct bar_surface *surface;
+    uint64_t commit_time;
+};
+
+static struct feedback feedbacks[MAX_FEEDBACK];
+
+static uint64_t presentation_now(void) {
+    struct timespec ts;
+    clock_gettime(presentation_clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void finish_feedback(struct feedback *slot) {
+    if (slot->surface) {
+        slot->surface->frames_in_flight--;
     }
+    wp_presentation_feedback_destroy(slot->feedback);
+    *slot = (struct feedback){0};
+}
 
-    if (!eglInitialize(egl_display, &major, &minor)) {
-        fprintf(stderr, "Can't initialize egl display\n");
-        exit(1);
+static void feedback_sync_output(void *data, struct wp_presentation_feedback *feedback,
+                                 struct wl_output *output) {
+}
+
+static void feedback_presented(void *data, struct wp_presentation_feedback *feedback,
+                               uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec,
+                               uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo,
+                               uint32_t flags) {
+    struct feedback *slot = data;
+    uint64_t present = (((uint64_t)tv_sec_hi << 32) | tv_sec_lo) * 1000000000 + tv_nsec;
+
+    stats_count(STATS_FRAMES_PRESENTED);
+    if (flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) {
+        stats_count(STATS_FRAMES_VSYNC);
+    }
+    if (flags & WP_PRESENTATION_FEEDBACK_KIND_ZERO_COPY) {
+        stats_count(STATS_FRAMES_ZERO_COPY);
+    }
+    if (present > slot->commit_time) {
+        stats_record_ns(STATS_PRESENT_LATENCY, present - slot->commit_time);
     }
 
-    EGLint count;
-    EGLint config_attribs[] = {
-        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-        EGL_RED_SIZE, 8,
-        EGL_GREEN_SIZE, 8,
-        EGL_BLUE_SIZE, 8,
-        EGL_ALPHA_SIZE, 8,
-        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-        EGL_NONE
-    };
+    struct bar_surface *surface = slot->surface;
+    if (surface) {
+        if (surface->last_present && present > surface->last_present) {
+            stats_record_ns(STATS_PRESENT_INTERVAL, present - surface->last_present);
+        }
+        surface->last_present = present;
+        frame_timing_presented(surface->timing, present, refresh);
+        event_loop_set_frame_timing(surface->timing, presentation_clock);
+    }
+    finish_feedback(slot);
+}
 
-    if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &count)) {
-        fprintf(stderr, "Cannot choose EGL config\n");
-        exit(1);
+static void feedback_discarded(void *data, struct wp_presentation_feedback *feedback) {
+    stats_count(STATS_FRAMES_DISCARDED);
+    finish_feedback(data);
+}
+
+static const struct wp_presentation_feedback_listener feedback_listener = {
+    .sync_output = feedback_sync_output,
+    .presented = feedback_presented,
+    .discarded = feedback_discarded,
+};
+
+/* Applies to the next commit of the surface. */
+static struct feedback *request_feedback(struct bar_surface *surface) {
+    if (presentation == NULL) {
+        return NULL;
     }
+    for (int i = 0; i < MAX_FEEDBACK; i++) {
+        struct feedback *slot = &feedbacks[i];
+        if (slot->feedback == NULL) {
+            slot->feedback = wp_presentation_feedback(presentation, surface->surface);
+            slot->surface = surface;
+            surface->frames_in_flight++;
+            wp_presentation_feedback_add_listener(slot->feedback, &feedback_listener, slot);
+            return slot;
+        }
+    }
+    return NULL;
+}
 
-    egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, 
-                                   (EGLint[]){EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE});
-    if (egl_context == EGL_NO_CONTEXT) {
-        fprintf(stderr, "Cannot create EGL context\n");
-        exit(1);
+/* Feedback for a destroyed surface still arrives but updates nothing. */
+static void forget_feedback(struct bar_surface *surface) {
+    for (int i = 0; i < MAX_FEEDBACK; i++) {
+        if (feedbacks[i].surface == surface) {
+            feedbacks[i].surface = NULL;
+        }
     }
 }
 
-static void create_egl_surface() {
-    if (egl_surface != EGL_NO_SURFACE) {
-        eglDestroySurface(egl_display, egl_surface);
+static void presentation_clock_id(void *data, struct wp_presentation *presentation,
+                                  uint32_t clk_id) {
+    presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener presentation_listener = {
+    .clock_id = presentation_clock_id,
+};
+
+static void schedule_frame(struct bar_surface *surface) {
+    if (surface->dirty) {
+        stats_count(STATS_FRAMES_SKIPPED);
     }
-    if (egl_window) {
-        wl_egl_window_destroy(egl_window);
+    surface->dirty = true;
+}
+
+static void damage_frame(struct bar_surface *surface, struct rect rect) {
+    damage_add(&surface->pending_damage, rect);
+    schedule_frame(surface);
+}
+
+static void damage_frame_full(struct bar_surface *surface) {
+    damage_frame(surface, (struct rect){0, 0, surface->area.width, surface->area.height});
+}
+
+static void draw_frame(struct bar_surface *surface) {
+    if (surface->target == NULL || !surface->dirty || surface->frame_callback) {
+        return;
     }
-    egl_window = wl_egl_window_create(surface, width, height);
-    egl_surface = eglCreateWindowSurface(egl_display, config, egl_window, NULL);
-    if (egl_surface == EGL_NO_SURFACE) {
-        fprintf(stderr, "Failed to create EGL surface\n");
-        exit(1);
+
+    damage_clip(&surface->pending_damage, surface->area.width, surface->area.height);
+    if (surface->pending_damage.count == 0) {
+        surface->dirty = false;
+        return;
+    }
+    /* Stay dirty; the feedback that frees a slot wakes us. */
+    if (nonblocking && surface->frames_in_flight >= MAX_FRAMES_IN_FLIGHT) {
+        stats_count(STATS_FRAMES_THROTTLED);
+        return;
+    }
+    uint64_t start = stats_now();
+
+    /*
+     * Out of buffers: stay dirty, a wl_buffer.release (or the render thread
+     * finishing a snapshot) will wake us.
+     */
+    if (!backend->acquire(surface->target)) {
+        return;
+    }
+    surface->dirty = false;
+
+    /* Must be requested before present, which commits the surface. */
+    surface->frame_callback = wl_surface_frame(surface->surface);
+    wl_callback_add_listener(surface->frame_callback, &frame_listener, surface);
+    struct feedback *feedback = request_feedback(surface);
+
+    backend->present(surface->target, surface->scene, &surface->pending_damage);
+    if (feedback) {
+        feedback->commit_time = presentation_now();
+    }
+    damage_clear(&surface->pending_damage);
+    stats_milestone(STATS_FIRST_COMMIT);
+
+    stats_count(STATS_FRAMES_DRAWN);
+    stats_record(STATS_DRAW, start);
+    drew_frame = true;
+    if (surface->frame_done_time) {
+        stats_record(STATS_CALLBACK_TO_PRESENT, surface->frame_done_time);
+        surface->frame_done_time = 0;
+    }
+}
+
+/* Points the surface at a new area, resizing its buffers as needed. */
+static void set_surface_area(struct bar_surface *surface, struct rect area) {
+    if (surface->target == NULL) {
+        surface->target = backend->create_target(surface->surface, area.width, area.height);
+    } else if (area.width != surface->area.width || area.height != surface->area.height) {
+        backend->resize_target(surface->target, area.width, area.height);
     }
+    surface->target->x = area.x;
+    surface->target->y = area.y;
+    surface->area = area;
+    damage_frame_full(surface);
 }
 
-static void draw_frame(void) {
-    if (egl_surface == EGL_NO_SURFACE) {
+static void destroy_surface(struct bar_surface *surface) {
+    forget_feedback(surface);
+    if (surface->frame_callback) wl_callback_destroy(surface->frame_callback);
+    /* The target takes the surface with it, after the frames it still has queued. */
+    if (surface->target) {
+        surface->target->subsurface = surface->subsurface;
+        surface->target->viewport = surface->viewport;
+        backend->destroy_target(surface->target);
+    } else {
+        if (surface->viewport) wp_viewport_destroy(surface->viewport);
+        if (surface->subsurface) wl_subsurface_destroy(surface->subsurface);
+        if (surface->surface) wl_surface_destroy(surface->surface);
+    }
+    *surface = (struct bar_surface){0};
+}
+
+static struct fcft_font *load_scaled_font(uint32_t scale) {
+    char attributes[32];
+    snprintf(attributes, sizeof(attributes), "dpi=%u", 96 * scale / SCALE_ONE);
+    return fcft_from_name(1, (const char *[]){font_name}, attributes);
+}
+
+static void *load_font(void *data) {
+    font = load_scaled_font(SCALE_ONE);
+    scaled_fonts[0].scale = SCALE_ONE;
+    scaled_fonts[0].font = font;
+    scaled_font_count = font ? 1 : 0;
+    stats_milestone(STATS_FONT_LOADED);
+    return NULL;
+}
+
+static struct fcft_font *font_for_scale(uint32_t scale) {
+    int nearest = 0;
+    for (int i = 0; i < scaled_font_count; i++) {
+        if (scaled_fonts[i].scale == scale) {
+            return scaled_fonts[i].font;
+        }
+        if (abs((int)scaled_fonts[i].scale - (int)scale) <
+            abs((int)scaled_fonts[nearest].scale - (int)scale)) {
+            nearest = i;
+        }
+    }
+    /* Fonts are never freed while the atlas may hold their glyphs. */
+    if (scaled_font_count == MAX_SCALES) {
+        return scaled_fonts[nearest].font;
+    }
+    struct fcft_font *scaled = load_scaled_font(scale);
+    if (scaled == NULL) {
+        return scaled_fonts[nearest].font;
+    }
+    scaled_fonts[scaled_font_count].scale = scale;
+    scaled_fonts[scaled_font_count].font = scaled;
+    scaled_font_count++;
+    return scaled;
+}
+
+static void *init_backend(void *data) {
+    backend->init(display, shm);
+    stats_milestone(STATS_BACKEND_READY);
+    return NULL;
+}
+
+static void start_thread(pthread_t *thread, void *(*fn)(void *), bool *pending) {
+    int err = pthread_create(thread, NULL, fn, NULL);
+    if (err != 0) {
+        /* Not fatal: the work is just done inline instead. */
+        fn(NULL);
+        return;
+    }
+    *pending = true;
+}
+
+static void join_thread(pthread_t thread, bool *pending) {
+    if (*pending) {
+        pthread_join(thread, NULL);
+        *pending = false;
+    }
+}
+
+static uint32_t bar_scale(const struct bar *bar) {
+    if (bar->main.viewport && bar->preferred_scale) {
+        return bar->preferred_scale;
+    }
+    return bar->output_scale * SCALE_ONE;
+}
+
+static int32_t to_surface_local(const struct bar *bar, int32_t pixels) {
+    return (pixels * SCALE_ONE + bar->scale / 2) / bar->scale;
+}
+
+static bool rect_intersects(struct rect a, struct rect b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+           a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+/* Replaces a position queued earlier for the same block. */
+static void queue_position(struct bar *bar, struct bar_surface *block, struct rect box) {
+    struct render_target *target = bar->main.target;
+    int i = 0;
+    while (i < target->position_count && target->positions[i].subsurface != block->subsurface) {
+        i++;
+    }
+    target->positions[i] = (struct subsurface_position){
+        block->subsurface, to_surface_local(bar, box.x), to_surface_local(bar, box.y),
+    };
+    if (i == target->position_count) {
+        target->position_count++;
+    }
+}
+
+/* For a block going away before the bar drew its move. */
+static void forget_position(struct bar *bar, struct bar_surface *block) {
+    struct render_target *target = bar->main.target;
+    for (int i = 0; i < target->position_count; i++) {
+        if (target->positions[i].subsurface == block->subsurface) {
+            target->positions[i] = target->positions[--target->position_count];
+            return;
+        }
+    }
+}
+
+/*
+ * Brings the block subsurfaces in line with the layout: blocks that moved
+ * or resized are repositioned and fully redrawn, blocks touched by the
+ * scene damage get that damage, surplus subsurfaces go away. Positions
+ * belong to the parent's state; they are queued on the bar's target and
+ * set by the renderer right before it commits the backdrop, so with -t
+ * they cannot land with an older frame that is still being committed.
+ */
+static void sync_block_surfaces(struct bar *bar, const struct damage *scene_damage) {
+    if (!use_subsurfaces || bar->main.target == NULL) {
         return;
     }
-    glViewport(0, 0, width, height);
-    glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-    eglSwapBuffers(egl_display, egl_surface);
+    for (int i = 0; i < bar->scene.count; i++) {
+        struct rect box = bar->scene.blocks[i].box;
+        struct bar_surface *surface = &bar->blocks[i];
+        if (surface->surface == NULL) {
+            surface->surface = wl_compositor_create_surface(compositor);
+            surface->subsurface = wl_subcompositor_get_subsurface(subcompositor, surface->surface,
+                                                                  bar->main.surface);
+            wl_subsurface_set_desync(surface->subsurface);
+            surface->viewport = wp_viewporter_get_viewport(viewporter, surface->surface);
+            surface->scene = &bar->scene;
+            surface->timing = &bar->timing;
+            surface->area = (struct rect){-1, -1, 0, 0};
+        }
+
+        /*
+         * Damaging where the block was and goes makes the backdrop's next
+         * frame, which carries the position, repaint both.
+         */
+        if (box.x != surface->area.x || box.y != surface->area.y) {
+            queue_position(bar, surface, box);
+            if (surface->area.width > 0) {
+                damage_frame(&bar->main, surface->area);
+            }
+            damage_frame(&bar->main, box);
+        }
+        if (box.x != surface->area.x || box.y != surface->area.y ||
+            box.width != surface->area.width || box.height != surface->area.height) {
+            wp_viewport_set_destination(surface->viewport, to_surface_local(bar, box.width),
+                                        to_surface_local(bar, box.height));
+            set_surface_area(surface, box);
+            continue;
+        }
+        for (int j = 0; j < scene_damage->count; j++) {
+            struct rect r = scene_damage->rects[j];
+            if (rect_intersects(r, box)) {
+                damage_frame(surface, (struct rect){r.x - box.x, r.y - box.y, r.width, r.height});
+            }
+        }
+    }
+    for (int i = bar->scene.count; i < bar->block_count; i++) {
+        forget_position(bar, &bar->blocks[i]);
+        destroy_surface(&bar->blocks[i]);
+    }
+    bar->block_count = bar->scene.count;
+}
+
+/*
+ * Buffers are allocated at exactly the device pixels the output needs.
+ * Fractional scales go through the viewport with a buffer scale of 1;
+ * without wp_fractional_scale_v1 the integer wl_output scale is used.
+ */
+static void update_geometry(struct bar *bar) {
+    if (bar->main.surface == NULL || bar->surface_width == 0) {
+        return;
+    }
+    uint32_t scale = bar_scale(bar);
+    /* Rounded half away from zero, as the fractional scale protocol says. */
+    uint32_t width = (bar->surface_width * scale + SCALE_ONE / 2) / SCALE_ONE;
+    uint32_t height = (bar->surface_height * scale + SCALE_ONE / 2) / SCALE_ONE;
+
+    /* Reconfigure storms mostly repeat the current geometry. */
+    if (bar->main.target && scale == bar->scale && width == bar->width && height == bar->height) {
+        return;
+    }
+
+    if (bar->main.viewport) {
+        wp_viewport_set_destination(bar->main.viewport, bar->surface_width, bar->surface_height);
+    }
+    if (scale != bar->scale) {
+        if (bar->main.viewport == NULL) {
+            wl_surface_set_buffer_scale(bar->main.surface, scale / SCALE_ONE);
+        }
+        struct fcft_font *scaled = font_for_scale(scale);
+        scene_set_font(&bar->scene, scaled, BLOCK_PADDING * scale / SCALE_ONE);
+        scene_set_font(&bar->backdrop, scaled, BLOCK_PADDING * scale / SCALE_ONE);
+        struct block_style style = block_style;
+        style.radius = style.radius * scale / SCALE_ONE;
+        style.border_width = style.border_width * scale / SCALE_ONE;
+        style.margin = style.margin * scale / SCALE_ONE;
+        style.shadow = style.shadow * scale / SCALE_ONE;
+        scene_set_style(&bar->scene, &style);
+        bar->scale = scale;
+    }
+
+    bar->width = width;
+    bar->height = height;
+    if (bar->main.target == NULL) {
+        stats_milestone(STATS_CONFIGURED);
+        join_thread(backend_thread, &backend_pending);
+    }
+    scene_resize(&bar->scene, bar->width, bar->height);
+    scene_resize(&bar->backdrop, bar->width, bar->height);
+    set_surface_area(&bar->main, (struct rect){0, 0, bar->width, bar->height});
+
+    /* A new scale invalidates every block; a new width may move them all. */
+    struct damage full = {0};
+    damage_add(&full, (struct rect){0, 0, bar->width, bar->height});
+    sync_block_surfaces(bar, &full);
 }
 
 static void layer_surface_configure(void *data,
                                     struct zwlr_layer_surface_v1 *layer_surface,
                                     uint32_t serial, uint32_t new_width, uint32_t new_height) {
+    struct bar *bar = data;
     zwlr_layer_surface_v1_ack_configure(layer_surface, serial);
 
-    width = new_width > 0 ? new_width : width;
-    height = new_height > 0 ? new_height : height;
-
-    create_egl_surface();
-
-    if (!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context)) {
-        fprintf(stderr, "eglMakeCurrent failed\n");
-        exit(1);
+    if (new_width > 0) {
+        bar->surface_width = new_width;
     }
+    if (new_height > 0) {
+        bar->surface_height = new_height;
+    }
+    update_geometry(bar);
+}
 
-    draw_frame();
+static void destroy_bar_surface(struct bar *bar) {
+    for (int i = 0; i < bar->block_count; i++) {
+        destroy_surface(&bar->blocks[i]);
+    }
+    bar->block_count = 0;
+    if (bar->fractional_scale) wp_fractional_scale_v1_destroy(bar->fractional_scale);
+    if (bar->layer_surface) zwlr_layer_surface_v1_destroy(bar->layer_surface);
+    destroy_surface(&bar->main);
+    bar->fractional_scale = NULL;
+    bar->layer_surface = NULL;
+    bar->preferred_scale = 0;
+    bar->scale = 0;
+    bar->surface_width = bar->surface_height = 0;
 }
 
 static void layer_surface_closed(void *data,
         struct zwlr_layer_surface_v1 *layer_surface) {
-    exit(0);
+    destroy_bar_surface(data);
 }
 
 static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
@@ -118,18 +653,209 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
     .closed = layer_surface_closed,
 };
 
+static void fractional_scale_preferred_scale(void *data,
+                                             struct wp_fractional_scale_v1 *fractional_scale,
+                                             uint32_t scale) {
+    struct bar *bar = data;
+    bar->preferred_scale = scale;
+    update_geometry(bar);
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+    .preferred_scale = fractional_scale_preferred_scale,
+};
+
+static void create_bar_surface(struct bar *bar) {
+    struct damage damage = {0};
+    scene_init(&bar->scene, font);
+    scene_set_status(&bar->scene, status, &damage);
+    scene_init(&bar->backdrop, font);
+    bar->main.scene = use_subsurfaces ? &bar->backdrop : &bar->scene;
+    bar->main.timing = &bar->timing;
+
+    bar->main.surface = wl_compositor_create_surface(compositor);
+    if (viewporter && fractional_scale_manager) {
+        bar->main.viewport = wp_viewporter_get_viewport(viewporter, bar->main.surface);
+        bar->fractional_scale = wp_fractional_scale_manager_v1_get_fractional_scale(
+            fractional_scale_manager, bar->main.surface);
+        wp_fractional_scale_v1_add_listener(bar->fractional_scale,
+                                            &fractional_scale_listener, bar);
+    }
+    bar->layer_surface = zwlr_layer_shell_v1_get_layer_surface(layer_shell,
+                                                               bar->main.surface, bar->output,
+                                                               ZWLR_LAYER_SHELL_V1_LAYER_TOP, "panel");
+
+    /* A full-width bar along the top edge; the compositor picks the width. */
+    zwlr_layer_surface_v1_set_anchor(bar->layer_surface,
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP |
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT |
+                                     ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
+    zwlr_layer_surface_v1_set_size(bar->layer_surface, 0, bar_height);
+    zwlr_layer_surface_v1_set_exclusive_zone(bar->layer_surface, bar_height);
+    zwlr_layer_surface_v1_add_listener(bar->layer_surface, &layer_surface_listener, bar);
+    wl_surface_commit(bar->main.surface);
+}
+
+static void set_output_name(struct bar *bar, const char *name) {
+    free(bar->name);
+    bar->name = strdup(name);
+}
+
+static void output_geometry(void *data, struct wl_output *output, int32_t x, int32_t y,
+                            int32_t physical_width, int32_t physical_height,
+                            int32_t subpixel, const char *make, const char *model,
+                            int32_t transform) {
+}
+
+static void output_mode(void *data, struct wl_output *output, uint32_t flags,
+                        int32_t width, int32_t height, int32_t refresh) {
+}
+
+static void output_done(void *data, struct wl_output *output) {
+    update_geometry(data);
+}
+
+static void output_scale(void *data, struct wl_output *output, int32_t factor) {
+    struct bar *bar = data;
+    bar->output_scale = factor > 0 ? factor : 1;
+}
+
+static void output_name(void *data, struct wl_output *output, const char *name) {
+    set_output_name(data, name);
+}
+
+static void output_description(void *data, struct wl_output *output, const char *description) {
+}
+
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+    .name = output_name,
+    .description = output_description,
+};
+
+static void xdg_output_logical_position(void *data, struct zxdg_output_v1 *xdg_output,
+                                        int32_t x, int32_t y) {
+    struct bar *bar = data;
+    bar->output_x = x;
+    bar->output_y = y;
+}
+
+static void xdg_output_logical_size(void *data, struct zxdg_output_v1 *xdg_output,
+                                    int32_t width, int32_t height) {
+    struct bar *bar = data;
+    bar->output_width = width;
+    bar->output_height = height;
+}
+
+static void xdg_output_done(void *data, struct zxdg_output_v1 *xdg_output) {
+}
+
+/* wl_output.name (version 4) wins when both are available. */
+static void xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output, const char *name) {
+    struct bar *bar = data;
+    if (bar->name == NULL) {
+        set_output_name(bar, name);
+    }
+}
+
+static void xdg_output_description(void *data, struct zxdg_output_v1 *xdg_output,
+                                   const char *description) {
+}
+
+static const struct zxdg_output_v1_listener xdg_output_listener = {
+    .logical_position = xdg_output_logical_position,
+    .logical_size = xdg_output_logical_size,
+    .done = xdg_output_done,
+    .name = xdg_output_name,
+    .description = xdg_output_description,
+};
+
+static void get_xdg_output(struct bar *bar) {
+    if (xdg_output_manager == NULL || bar->xdg_output) {
+        return;
+    }
+    bar->xdg_output = zxdg_output_manager_v1_get_xdg_output(xdg_output_manager, bar->output);
+    zxdg_output_v1_add_listener(bar->xdg_output, &xdg_output_listener, bar);
+}
+
+static void add_output(struct wl_registry *registry, uint32_t name, uint32_t version) {
+    struct bar *bar = calloc(1, sizeof(*bar));
+    if (bar == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    bar->global_name = name;
+    bar->output_scale = 1;
+    bar->output = wl_registry_bind(registry, name, &wl_output_interface,
+                                   version < 4 ? version : 4);
+    wl_output_add_listener(bar->output, &output_listener, bar);
+    get_xdg_output(bar);
+    wl_list_insert(bars.prev, &bar->link);
+    if (bars_ready) {
+        create_bar_surface(bar);
+    }
+}
+
+static void destroy_bar(struct bar *bar) {
+    destroy_bar_surface(bar);
+    if (bar->xdg_output) zxdg_output_v1_destroy(bar->xdg_output);
+    if (wl_output_get_version(bar->output) >= WL_OUTPUT_RELEASE_SINCE_VERSION) {
+        wl_output_release(bar->output);
+    } else {
+        wl_output_destroy(bar->output);
+    }
+    wl_list_remove(&bar->link);
+    free(bar->name);
+    free(bar);
+}
+
 static void registry_global(void *data, struct wl_registry *registry,
         uint32_t name, const char *interface, uint32_t version) {
     if (strcmp(interface, wl_compositor_interface.name) == 0) {
         compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
     } else if (strcmp(interface, zwlr_layer_shell_v1_interface.name) == 0) {
         layer_shell = wl_registry_bind(registry, name, &zwlr_layer_shell_v1_interface, 1);
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        add_output(registry, name, version);
+    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
+        subcompositor = wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
+    } else if (strcmp(interface, wp_presentation_interface.name) == 0) {
+        presentation = wl_registry_bind(registry, name, &wp_presentation_interface, 1);
+        wp_presentation_add_listener(presentation, &presentation_listener, NULL);
+    } else if (strcmp(interface, wp_viewporter_interface.name) == 0) {
+        viewporter = wl_registry_bind(registry, name, &wp_viewporter_interface, 1);
+    } else if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) == 0) {
+        fractional_scale_manager = wl_registry_bind(registry, name,
+                                                    &wp_fractional_scale_manager_v1_interface, 1);
+    } else if (strcmp(interface, zxdg_output_manager_v1_interface.name) == 0) {
+        xdg_output_manager = wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface,
+                                              version < 3 ? version : 3);
+        struct bar *bar;
+        wl_list_for_each(bar, &bars, link) {
+            get_xdg_output(bar);
+        }
     }
 }
 
+/*
+ * Only outputs come and go in practice. Removing one tears down just its
+ * bar; the backend, glyph atlas and status stay warm for the others and for
+ * whatever output appears next.
+ */
 static void registry_global_remove(void *data, struct wl_registry *registry,
         uint32_t name) {
-    // 필요한 경우 여기에 정리 코드를 추가합니다
+    struct bar *bar;
+    wl_list_for_each(bar, &bars, link) {
+        if (bar->global_name == name) {
+            destroy_bar(bar);
+            return;
+        }
+    }
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -137,26 +863,384 @@ static const struct wl_registry_listener registry_listener = {
     .global_remove = registry_global_remove,
 };
 
-static void cleanup(void) {
-    if (egl_display != EGL_NO_DISPLAY) {
-        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-        if (egl_context != EGL_NO_CONTEXT) {
-            eglDestroyContext(egl_display, egl_context);
+static void flush_display(void) {
+    bool wants_write = false;
+    if (wl_display_flush(display) < 0) {
+        if (errno != EAGAIN) {
+            perror("wl_display_flush");
+            running = false;
+            return;
+        }
+        /* Socket buffer full: finish the flush once it becomes writable. */
+        wants_write = true;
+    }
+    if (wants_write != display_wants_write) {
+        display_wants_write = wants_write;
+        event_source_fd_update(display_source, EPOLLIN | (wants_write ? EPOLLOUT : 0));
+    }
+}
+
+static void handle_display_event(void *data, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        fprintf(stderr, "Wayland connection closed\n");
+        running = false;
+        return;
+    }
+    if (events & EPOLLIN) {
+        display_read = true;
+        if (wl_display_read_events(display) < 0) {
+            perror("wl_display_read_events");
+            running = false;
+        }
+    }
+    if (events & EPOLLOUT) {
+        flush_display();
+    }
+}
+
+/* Scenes only measure and damage the blocks whose text changed. */
+static void update_status(void) {
+    size_t length = snprintf(status, sizeof(status), "%s", input_status);
+    modules_compose(status, length, sizeof(status));
+    struct bar *bar;
+    wl_list_for_each(bar, &bars, link) {
+        if (bar->main.surface == NULL) {
+            continue;
+        }
+        if (use_subsurfaces) {
+            struct damage damage = {0};
+            scene_set_status(&bar->scene, status, &damage);
+            sync_block_surfaces(bar, &damage);
+        } else {
+            scene_set_status(&bar->scene, status, &bar->main.pending_damage);
+            if (bar->main.pending_damage.count > 0) {
+                schedule_frame(&bar->main);
+            }
+        }
+    }
+}
+
+static void set_status(const char *text) {
+    snprintf(input_status, sizeof(input_status), "%s", text);
+    update_status();
+}
+
+/* Returns false once stdin is at end of file or broken. */
+static bool read_status(void) {
+    for (;;) {
+        ssize_t n = read(STDIN_FILENO, stdin_buffer + stdin_length,
+                         sizeof(stdin_buffer) - 1 - stdin_length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EAGAIN;
+        } else if (n == 0) {
+            return false;
+        }
+        stdin_length += n;
+
+        char *last = NULL, *end = NULL;
+        for (char *p = stdin_buffer; (p = memchr(p, '\n', stdin_buffer + stdin_length - p)); p++) {
+            last = end ? end + 1 : stdin_buffer;
+            end = p;
+        }
+        if (end == NULL) {
+            if (stdin_length < sizeof(stdin_buffer) - 1) {
+                continue;
+            }
+            /* A line longer than the buffer is cut where the buffer ends. */
+            last = stdin_buffer;
+            end = stdin_buffer + stdin_length;
+        }
+
+        *end = '\0';
+        set_status(last);
+        size_t consumed = end < stdin_buffer + stdin_length ? end + 1 - stdin_buffer : stdin_length;
+        memmove(stdin_buffer, stdin_buffer + consumed, stdin_length - consumed);
+        stdin_length -= consumed;
+    }
+}
+
+static void handle_stdin(void *data, uint32_t events) {
+    if (!read_status()) {
+        event_source_remove(stdin_source);
+        stdin_source = NULL;
+    }
+}
+
+static void watch_stdin(void) {
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) < 0) {
+        return;
+    }
+    /* epoll refuses regular files; they are read to the end right away. */
+    if (S_ISREG(st.st_mode)) {
+        read_status();
+        return;
+    }
+    /* Nor does it take /dev/null, the usual stdin under a compositor: no status input. */
+    stdin_source = event_loop_add_fd(STDIN_FILENO, EPOLLIN, handle_stdin, NULL);
+    if (stdin_source == NULL) {
+        return;
+    }
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    event_source_set_name(stdin_source, "stdin");
+}
+
+static void handle_terminate(void *data, uint32_t signo) {
+    running = false;
+}
+
+static void handle_idle(void *data, uint32_t events) {
+    backend->trim();
+}
+
+static void handle_render_done(void *data, uint32_t events) {
+    render_thread_clear();
+}
+
+static void print_wakeups(const char *name, uint64_t wakeups, void *data) {
+    fprintf(data, "wakeups %s %llu\n", name, (unsigned long long)wakeups);
+}
+
+static void dump_stats(FILE *out) {
+    stats_dump(out);
+    struct bar *bar;
+    wl_list_for_each(bar, &bars, link) {
+        fprintf(out, "output %s %dx%d+%d+%d bar %ux%u scale %.3f refresh_us %.1f\n",
+                bar->name ? bar->name : "?",
+                bar->output_width, bar->output_height, bar->output_x, bar->output_y,
+                bar->width, bar->height, bar->scale / (double)SCALE_ONE,
+                bar->timing.refresh_ns / 1e3);
+    }
+    struct atlas_stats atlas;
+    atlas_get_stats(&atlas);
+    fprintf(out, "atlas pages %d hits %llu misses %llu uploaded_pixels %llu "
+            "evictions %llu compactions %llu resets %llu\n", atlas.pages,
+            (unsigned long long)atlas.hits, (unsigned long long)atlas.misses,
+            (unsigned long long)atlas.uploaded_pixels, (unsigned long long)atlas.evictions,
+            (unsigned long long)atlas.compactions, (unsigned long long)atlas.resets);
+    modules_dump(out);
+    event_loop_for_each_source(print_wakeups, out);
+    fflush(out);
+}
+
+static void handle_dump_signal(void *data, uint32_t signo) {
+    dump_stats(stderr);
+}
+
+/*
+ * The dump is formatted into a fixed buffer and sent in one non-blocking
+ * write, so a client that never reads cannot stall the loop; one whose
+ * socket buffer is full just gets a short dump.
+ */
+static void handle_stats_query(void *data, uint32_t events) {
+    static char buffer[65536];
+    int fd = accept4(stats_socket, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+    FILE *out = fmemopen(buffer, sizeof(buffer), "w");
+    if (out) {
+        dump_stats(out);
+        /* ftell() counts what did not fit too; the stream keeps room for a NUL. */
+        long length = ftell(out);
+        fclose(out);
+        if (length < 0 || length > (long)sizeof(buffer) - 1) {
+            length = sizeof(buffer) - 1;
+        }
+        send(fd, buffer, length, MSG_NOSIGNAL);
+    }
+    close(fd);
+}
+
+/* Every connection to the socket receives one stats dump. */
+static void listen_stats_socket(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Stats socket path too long\n");
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+
+    stats_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    unlink(path);
+    if (stats_socket < 0 ||
+        bind(stats_socket, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(stats_socket, 4) < 0) {
+        perror(path);
+        exit(1);
+    }
+    struct event_source *source =
+        event_loop_add_fd(stats_socket, EPOLLIN, handle_stats_query, NULL);
+    if (source == NULL) {
+        perror("epoll_ctl");
+        exit(1);
+    }
+    event_source_set_name(source, "stats");
+}
+
+/*
+ * The read intention is taken before sleeping so that events queued by
+ * anyone else (Mesa reads the socket during eglSwapBuffers) are dispatched
+ * first instead of being stranded until the next wakeup. Callbacks of other
+ * sources run while the read is prepared and must not touch the display.
+ */
+static void run(void) {
+    while (running) {
+        /* However many modules changed in one wakeup, the status is built once. */
+        if (modules_dirty()) {
+            update_status();
+        }
+        uint64_t start = stats_now();
+        int dispatched = wl_display_dispatch_pending(display);
+        if (dispatched < 0) {
+            perror("wl_display_dispatch_pending");
+            break;
+        } else if (dispatched > 0) {
+            stats_record(STATS_DISPATCH, start);
+        }
+        struct bar *bar;
+        wl_list_for_each(bar, &bars, link) {
+            draw_frame(&bar->main);
+            for (int i = 0; i < bar->block_count; i++) {
+                draw_frame(&bar->blocks[i]);
+            }
+        }
+        if (drew_frame && idle_timer) {
+            event_source_timer_update_ms(idle_timer, IDLE_TRIM_MS);
+            drew_frame = false;
+        }
+        if (wl_display_prepare_read(display) != 0) {
+            continue;
         }
-        if (egl_surface != EGL_NO_SURFACE) {
-            eglDestroySurface(egl_display, egl_surface);
+        flush_display();
+
+        display_read = false;
+        int ret = event_loop_dispatch(-1);
+        if (!display_read) {
+            wl_display_cancel_read(display);
+        }
+        if (ret < 0) {
+            perror("epoll_wait");
+            break;
         }
-        eglTerminate(egl_display);
     }
-    if (egl_window) wl_egl_window_destroy(egl_window);
-    if (layer_surface) zwlr_layer_surface_v1_destroy(layer_surface);
-    if (surface) wl_surface_destroy(surface);
+}
+
+static void cleanup(void) {
+    struct bar *bar, *tmp;
+    wl_list_for_each_safe(bar, tmp, &bars, link) {
+        destroy_bar(bar);
+    }
+    join_thread(backend_thread, &backend_pending);
+    backend->finish();
+    if (xdg_output_manager) zxdg_output_manager_v1_destroy(xdg_output_manager);
+    if (fractional_scale_manager) wp_fractional_scale_manager_v1_destroy(fractional_scale_manager);
+    if (viewporter) wp_viewporter_destroy(viewporter);
+    if (subcompositor) wl_subcompositor_destroy(subcompositor);
+    for (int i = 0; i < MAX_FEEDBACK; i++) {
+        if (feedbacks[i].feedback) {
+            finish_feedback(&feedbacks[i]);
+        }
+    }
+    if (presentation) wp_presentation_destroy(presentation);
     if (layer_shell) zwlr_layer_shell_v1_destroy(layer_shell);
+    if (shm) wl_shm_destroy(shm);
     if (compositor) wl_compositor_destroy(compositor);
     if (display) wl_display_disconnect(display);
+    for (int i = 0; i < scaled_font_count; i++) {
+        fcft_destroy(scaled_fonts[i].font);
+    }
+    fcft_fini();
+    if (stats_socket >= 0) {
+        close(stats_socket);
+        unlink(stats_socket_path);
+    }
+    modules_finish();
+    event_loop_finish();
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-b egl|shm] [-f font] [-m module,...] [-s] [-n]\n"
+            "       [-r radius[,border[,margin[,shadow]]]] [-S stats-socket] [-t]\n", name);
+    exit(1);
 }
 
 int main(int argc, char **argv) {
+    stats_start();
+    int opt;
+    while ((opt = getopt(argc, argv, "b:f:m:nr:sS:t")) != -1) {
+        switch (opt) {
+        case 'b':
+            if (strcmp(optarg, egl_backend.name) == 0) {
+                backend = &egl_backend;
+            } else if (strcmp(optarg, shm_backend.name) == 0) {
+                backend = &shm_backend;
+            } else {
+                usage(argv[0]);
+            }
+            break;
+        case 'f':
+            font_name = optarg;
+            break;
+        case 'm':
+            module_names = optarg;
+            break;
+        case 'n':
+            nonblocking = true;
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d,%d,%d,%d", &block_style.radius, &block_style.border_width,
+                       &block_style.margin, &block_style.shadow) < 1) {
+                usage(argv[0]);
+            }
+            break;
+        case 's':
+            use_subsurfaces = true;
+            break;
+        case 'S':
+            stats_socket_path = optarg;
+            break;
+        case 't':
+            use_render_thread = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    /* shm buffers are released through the loop thread's dispatch. */
+    if (use_render_thread && backend != &egl_backend) {
+        fprintf(stderr, "The render thread needs the egl backend, rendering inline\n");
+        use_render_thread = false;
+    }
+    if (use_render_thread) {
+        backend = render_thread_wrap(backend);
+    }
+    if (nonblocking && backend->set_swap_interval) {
+        backend->set_swap_interval(0);
+    }
+
+    /*
+     * Masks are per thread and inherited, so the signals the event loop
+     * handles are blocked before any thread starts; otherwise the kernel
+     * may deliver them to a helper thread with the default action.
+     */
+    sigset_t handled;
+    sigemptyset(&handled);
+    sigaddset(&handled, SIGTERM);
+    sigaddset(&handled, SIGINT);
+    sigaddset(&handled, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &handled, NULL);
+    /* Peers of the stats and Wayland sockets may go away mid-write. */
+    signal(SIGPIPE, SIG_IGN);
+
+    fcft_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_ERROR);
+    start_thread(&font_thread, load_font, &font_pending);
+
+    wl_list_init(&bars);
     display = wl_display_connect(NULL);
     if (display == NULL) {
         fprintf(stderr, "Failed to connect to Wayland display\n");
@@ -172,20 +1256,66 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    init_egl();
-    surface = wl_compositor_create_surface(compositor);
-    layer_surface = zwlr_layer_shell_v1_get_layer_surface(layer_shell,
-                                                          surface, NULL, ZWLR_LAYER_SHELL_V1_LAYER_TOP, "example");
+    /* Block subsurfaces are sized through viewports at every scale. */
+    if (use_subsurfaces && (subcompositor == NULL || viewporter == NULL)) {
+        fprintf(stderr, "Subsurfaces need wl_subcompositor and wp_viewporter, "
+                "drawing the bar as one surface\n");
+        use_subsurfaces = false;
+    }
+
+    /* EGL talks to the compositor on its own event queue. */
+    start_thread(&backend_thread, init_backend, &backend_pending);
 
-    zwlr_layer_surface_v1_set_size(layer_surface, width, height);
-    zwlr_layer_surface_v1_set_exclusive_zone(layer_surface, -1);
-    zwlr_layer_surface_v1_add_listener(layer_surface, &layer_surface_listener, NULL);
+    /* The bar's height depends on the font, so it is needed from here on. */
+    join_thread(font_thread, &font_pending);
+    if (font == NULL) {
+        fprintf(stderr, "Failed to load font %s\n", font_name);
+        return 1;
+    }
+    bar_height = font->height + BLOCK_PADDING;
 
-    wl_surface_commit(surface);
+    bars_ready = true;
+    struct bar *bar;
+    wl_list_for_each(bar, &bars, link) {
+        create_bar_surface(bar);
+    }
+    wl_display_flush(display);
 
-    while (wl_display_dispatch(display) != -1) {
-        draw_frame();
+    event_loop_init();
+    display_source = event_loop_add_fd(wl_display_get_fd(display), EPOLLIN,
+                                       handle_display_event, NULL);
+    if (display_source == NULL) {
+        perror("epoll_ctl");
+        return 1;
     }
+    event_source_set_name(display_source, "wayland");
+    event_source_set_name(event_loop_add_signal(SIGTERM, handle_terminate, NULL), "SIGTERM");
+    event_source_set_name(event_loop_add_signal(SIGINT, handle_terminate, NULL), "SIGINT");
+    event_source_set_name(event_loop_add_signal(SIGUSR1, handle_dump_signal, NULL), "SIGUSR1");
+    if (use_render_thread) {
+        struct event_source *source = event_loop_add_fd(render_thread_get_fd(), EPOLLIN,
+                                                        handle_render_done, NULL);
+        if (source == NULL) {
+            perror("epoll_ctl");
+            return 1;
+        }
+        event_source_set_name(source, "render");
+    }
+    if (backend->trim) {
+        idle_timer = event_loop_add_timer(CLOCK_MONOTONIC, handle_idle, NULL);
+        event_source_set_name(idle_timer, "idle");
+    }
+    if (stats_socket_path) {
+        listen_stats_socket(stats_socket_path);
+    }
+    watch_stdin();
+    modules_init(module_names);
+
+    /*
+     * Events from one wakeup are coalesced into a single redraw; the frame
+     * callback wakes the loop again once the compositor wants a new frame.
+     */
+    run();
 
     cleanup();
     return 0;
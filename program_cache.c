@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include "program_cache.h"
+#include "render.h"
+
+#define CACHE_MAGIC 0x6d706263 /* "mpbc" */
+#define MAX_BINARY_SIZE (4 * 1024 * 1024)
+
+/* Precedes the binary in every cache file. */
+struct cache_header {
+    uint32_t magic;
+    uint32_t format;
+    uint64_t key;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+static PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+static PFNGLPROGRAMBINARYOESPROC program_binary;
+
+/* FNV-1a; the string terminator is hashed too, so fields cannot run together. */
+static uint64_t hash_string(uint64_t hash, const char *s) {
+    if (s == NULL) {
+        s = "";
+    }
+    do {
+        hash ^= (unsigned char)*s;
+        hash *= 0x100000001b3ull;
+    } while (*s++);
+    return hash;
+}
+
+static uint64_t cache_key(const char *vertex_source, const char *fragment_source,
+                          const char *const *attributes) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    hash = hash_string(hash, vertex_source);
+    hash = hash_string(hash, fragment_source);
+    for (int i = 0; attributes[i]; i++) {
+        hash = hash_string(hash, attributes[i]);
+    }
+    return hash;
+}
+
+static bool make_dir(const char *path) {
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+/* Creates the cache directory on the way; false when there is no home. */
+static bool cache_path(char *path, size_t size, uint64_t key) {
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    int n;
+    if (cache_home && cache_home[0] == '/') {
+        n = snprintf(path, size, "%s", cache_home);
+    } else {
+        const char *home = getenv("HOME");
+        if (home == NULL) {
+            return false;
+        }
+        n = snprintf(path, size, "%s/.cache", home);
+    }
+    if (n < 0 || (size_t)n >= size || !make_dir(path)) {
+        return false;
+    }
+    n += snprintf(path + n, size - n, "/mypanel");
+    if ((size_t)n >= size || !make_dir(path)) {
+        return false;
+    }
+    n += snprintf(path + n, size - n, "/%016llx.bin", (unsigned long long)key);
+    return (size_t)n < size;
+}
+
+static bool link_ok(GLuint program) {
+    GLint ok;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    return ok;
+}
+
+static GLuint load_cached(const char *path, uint64_t key) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    GLuint program = 0;
+    struct cache_header header;
+    void *binary = NULL;
+    if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+        header.magic != CACHE_MAGIC || header.key != key ||
+        header.length == 0 || header.length > MAX_BINARY_SIZE) {
+        goto out;
+    }
+    binary = malloc(header.length);
+    if (binary == NULL || read(fd, binary, header.length) != (ssize_t)header.length) {
+        goto out;
+    }
+
+    /* A driver that changed underneath without a version bump refuses it here. */
+    program = glCreateProgram();
+    program_binary(program, header.format, binary, header.length);
+    if (!link_ok(program)) {
+        glDeleteProgram(program);
+        program = 0;
+    }
+out:
+    free(binary);
+    close(fd);
+    return program;
+}
+
+/* Written to a temporary file first, so readers never see half of one. */
+static void store_cached(const char *path, uint64_t key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0 || length > MAX_BINARY_SIZE) {
+        return;
+    }
+    void *binary = malloc(length);
+    if (binary == NULL) {
+        return;
+    }
+    struct cache_header header = {.magic = CACHE_MAGIC, .key = key};
+    GLenum format;
+    GLsizei written = 0;
+    get_program_binary(program, length, &written, &format, binary);
+    header.format = format;
+    header.length = written;
+
+    char tmp[4096];
+    if (written > 0 && snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) < (int)sizeof(tmp)) {
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd >= 0) {
+            bool ok = write(fd, &header, sizeof(header)) == sizeof(header) &&
+                      write(fd, binary, written) == written;
+            close(fd);
+            if (!ok || rename(tmp, path) < 0) {
+                unlink(tmp);
+            }
+        }
+    }
+    free(binary);
+}
+
+static GLuint compile_shader(GLenum type, const char *source) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "Shader compilation failed: %s\n", log);
+        exit(1);
+    }
+    return shader;
+}
+
+static GLuint link_from_source(const char *vertex_source, const char *fragment_source,
+                               const char *const *attributes) {
+    GLuint vertex = compile_shader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex);
+    glAttachShader(program, fragment);
+    for (int i = 0; attributes[i]; i++) {
+        glBindAttribLocation(program, i, attributes[i]);
+    }
+    glLinkProgram(program);
+    glDeleteShader(vertex);
+    glDeleteShader(fragment);
+
+    if (!link_ok(program)) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Shader link failed: %s\n", log);
+        exit(1);
+    }
+    return program;
+}
+
+static bool cache_supported(void) {
+    if (!has_extension((const char *)glGetString(GL_EXTENSIONS), "GL_OES_get_program_binary")) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    if (formats == 0) {
+        return false;
+    }
+    if (get_program_binary == NULL) {
+        get_program_binary = (PFNGLGETPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glGetProgramBinaryOES");
+        program_binary = (PFNGLPROGRAMBINARYOESPROC)
+            eglGetProcAddress("glProgramBinaryOES");
+    }
+    return get_program_binary && program_binary;
+}
+
+GLuint program_cache_link(const char *vertex_source, const char *fragment_source,
+                          const char *const *attributes) {
+    char path[4096];
+    if (!cache_supported()) {
+        return link_from_source(vertex_source, fragment_source, attributes);
+    }
+    uint64_t key = cache_key(vertex_source, fragment_source, attributes);
+    if (!cache_path(path, sizeof(path), key)) {
+        return link_from_source(vertex_source, fragment_source, attributes);
+    }
+
+    GLuint program = load_cached(path, key);
+    if (program == 0) {
+        program = link_from_source(vertex_source, fragment_source, attributes);
+        store_cached(path, key, program);
+    }
+    return program;
+}
@@ -0,0 +1,19 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <GLES2/gl2.h>
+
+/*
+ * Links a GLSL program, reusing the binary from an earlier run when the
+ * driver supports GL_OES_get_program_binary. Binaries are kept in
+ * $XDG_CACHE_HOME/mypanel, keyed by the driver's vendor, renderer and
+ * version strings together with the sources and attribute bindings, so a
+ * driver upgrade or a shader change simply misses. Any problem with the
+ * cache falls back to compiling from source.
+ *
+ * attributes[i] is bound to location i; the list ends with NULL.
+ */
+GLuint program_cache_link(const char *vertex_source, const char *fragment_source,
+                          const char *const *attributes);
+
+#endif
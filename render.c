@@ -0,0 +1,473 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GLES2/gl2.h>
+#include <fcft/fcft.h>
+#include "atlas.h"
+#include "program_cache.h"
+#include "render.h"
+
+/*
+ * Everything is drawn as textured quads in one shader. The mode selects how
+ * the atlas sample is combined with the vertex colour; solid quads (block
+ * backgrounds) ignore the texture.
+ *
+ * Shape and shadow quads are rounded rectangles evaluated as a signed
+ * distance in the fragment shader, so they need no texture at any size.
+ * For them, u and v are the pixel offset from the rectangle's centre, and
+ * shape holds its half size, corner radius and border width (shapes) or
+ * blur (shadows). GLES2 has no instancing, so these per-shape parameters
+ * are repeated in each of the quad's vertices.
+ *
+ * Each atlas page is bound to its own texture unit and glyph vertices name
+ * their page, so glyphs from every page still go out in one draw.
+ */
+enum quad_mode {
+    QUAD_SOLID,
+    QUAD_MASK,
+    QUAD_COLOR,
+    QUAD_SUBPIXEL,
+    QUAD_SHAPE,
+    QUAD_SHADOW,
+};
+
+struct vertex {
+    GLfloat x, y;
+    GLfloat u, v;
+    GLubyte color[4]; /* premultiplied */
+    GLfloat mode;
+    GLfloat page;
+    GLfloat shape[4];
+    GLubyte border[4]; /* premultiplied */
+};
+
+/* Per block: the bar background, a shadow, the shape and the glyphs. */
+#define MAX_QUADS (SCENE_MAX_BLOCKS * (BLOCK_TEXT_MAX + 3))
+
+/*
+ * Subpixel glyphs need per-channel blending, which GLES2 can only do with
+ * two passes, so they are collected separately and drawn last.
+ *
+ * A frame's quads all go into one streaming vertex buffer: the subpixel
+ * vertices follow the others. The buffer is orphaned before every upload,
+ * so the driver hands out fresh storage instead of waiting for the GPU to
+ * finish reading the previous frame's.
+ */
+static struct vertex vertices[MAX_QUADS * 6];
+static struct vertex subpixel_vertices[MAX_QUADS * 6];
+static int vertex_count, subpixel_vertex_count;
+static GLuint vertex_buffer;
+
+static GLuint program;
+static GLint u_scale, u_pass, u_atlas;
+
+enum {
+    ATTRIB_POS,
+    ATTRIB_UV,
+    ATTRIB_COLOR,
+    ATTRIB_MODE,
+    ATTRIB_PAGE,
+    ATTRIB_SHAPE,
+    ATTRIB_BORDER,
+};
+
+_Static_assert(ATLAS_MAX_PAGES == 4, "the fragment shader samples four atlas pages");
+
+static const char vertex_source[] =
+    "attribute vec2 a_pos;\n"
+    "attribute vec2 a_uv;\n"
+    "attribute vec4 a_color;\n"
+    "attribute float a_mode;\n"
+    "attribute float a_page;\n"
+    "attribute vec4 a_shape;\n"
+    "attribute vec4 a_border;\n"
+    "uniform vec2 u_scale;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_color;\n"
+    "varying float v_mode;\n"
+    "varying float v_page;\n"
+    "varying vec4 v_shape;\n"
+    "varying vec4 v_border;\n"
+    "void main() {\n"
+    "    v_uv = a_uv;\n"
+    "    v_page = a_page;\n"
+    "    v_color = a_color;\n"
+    "    v_mode = a_mode;\n"
+    "    v_shape = a_shape;\n"
+    "    v_border = a_border;\n"
+    "    gl_Position = vec4(a_pos * u_scale + vec2(-1.0, 1.0), 0.0, 1.0);\n"
+    "}\n";
+
+/*
+ * u_pass only matters for subpixel glyphs: pass 0 darkens the destination by
+ * the per-channel coverage, pass 1 adds the coloured coverage on top.
+ * Distances are in pixels, so coverage is 0.5 minus the distance to the
+ * edge. Offsets from a wide block's centre need more than mediump.
+ */
+static const char fragment_source[] =
+    "#ifdef GL_FRAGMENT_PRECISION_HIGH\n"
+    "precision highp float;\n"
+    "#else\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D u_atlas[4];\n"
+    "uniform float u_pass;\n"
+    "varying vec2 v_uv;\n"
+    "varying vec4 v_color;\n"
+    "varying float v_mode;\n"
+    "varying float v_page;\n"
+    "varying vec4 v_shape;\n"
+    "varying vec4 v_border;\n"
+    "vec4 sample_atlas() {\n"
+    "    if (v_page < 0.5) return texture2D(u_atlas[0], v_uv);\n"
+    "    if (v_page < 1.5) return texture2D(u_atlas[1], v_uv);\n"
+    "    if (v_page < 2.5) return texture2D(u_atlas[2], v_uv);\n"
+    "    return texture2D(u_atlas[3], v_uv);\n"
+    "}\n"
+    "float rounded_box(vec2 p, vec2 half_size, float radius) {\n"
+    "    vec2 q = abs(p) - half_size + radius;\n"
+    "    return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;\n"
+    "}\n"
+    "void main() {\n"
+    "    vec4 t = sample_atlas();\n"
+    "    if (v_mode < 0.5) {\n"
+    "        gl_FragColor = v_color;\n"
+    "    } else if (v_mode < 1.5) {\n"
+    "        gl_FragColor = v_color * t.a;\n"
+    "    } else if (v_mode < 2.5) {\n"
+    "        gl_FragColor = t * v_color.a;\n"
+    "    } else if (v_mode < 3.5) {\n"
+    "        if (u_pass < 0.5) {\n"
+    "            gl_FragColor = t * v_color.a;\n"
+    "        } else {\n"
+    "            gl_FragColor = vec4(v_color.rgb * t.rgb, v_color.a * t.a);\n"
+    "        }\n"
+    "    } else {\n"
+    "        float d = rounded_box(v_uv, v_shape.xy, v_shape.z);\n"
+    "        if (v_mode < 4.5) {\n"
+    "            float outer = clamp(0.5 - d, 0.0, 1.0);\n"
+    "            float inner = clamp(0.5 - d - v_shape.w, 0.0, 1.0);\n"
+    "            gl_FragColor = v_color * inner + v_border * (outer - inner);\n"
+    "        } else {\n"
+    "            gl_FragColor = v_color * (1.0 - smoothstep(-v_shape.w, v_shape.w, d));\n"
+    "        }\n"
+    "    }\n"
+    "}\n";
+
+bool has_extension(const char *extensions, const char *name) {
+    size_t len = strlen(name);
+    const char *p = extensions;
+    while (p && (p = strstr(p, name)) != NULL) {
+        if ((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+        p += len;
+    }
+    return false;
+}
+
+void render_init(void) {
+    static const char *const attributes[] = {
+        [ATTRIB_POS] = "a_pos",
+        [ATTRIB_UV] = "a_uv",
+        [ATTRIB_COLOR] = "a_color",
+        [ATTRIB_MODE] = "a_mode",
+        [ATTRIB_PAGE] = "a_page",
+        [ATTRIB_SHAPE] = "a_shape",
+        [ATTRIB_BORDER] = "a_border",
+        NULL,
+    };
+    program = program_cache_link(vertex_source, fragment_source, attributes);
+    u_scale = glGetUniformLocation(program, "u_scale");
+    u_pass = glGetUniformLocation(program, "u_pass");
+    u_atlas = glGetUniformLocation(program, "u_atlas");
+    glGenBuffers(1, &vertex_buffer);
+
+    atlas_init();
+}
+
+void render_trim(void) {
+    atlas_compact();
+}
+
+void render_finish(void) {
+    atlas_finish();
+    glDeleteBuffers(1, &vertex_buffer);
+    vertex_buffer = 0;
+    glDeleteProgram(program);
+    program = 0;
+}
+
+static void premultiply(uint32_t argb, GLubyte out[4]) {
+    uint32_t a = argb >> 24;
+    out[0] = ((argb >> 16) & 0xff) * a / 255;
+    out[1] = ((argb >> 8) & 0xff) * a / 255;
+    out[2] = (argb & 0xff) * a / 255;
+    out[3] = a;
+}
+
+static void add_quad(struct vertex *out, int *count, float x0, float y0, float x1, float y1,
+                     float u0, float v0, float u1, float v1,
+                     const GLubyte color[4], enum quad_mode mode) {
+    struct vertex corners[4] = {
+        {x0, y0, u0, v0, {color[0], color[1], color[2], color[3]}, mode},
+        {x1, y0, u1, v0, {color[0], color[1], color[2], color[3]}, mode},
+        {x0, y1, u0, v1, {color[0], color[1], color[2], color[3]}, mode},
+        {x1, y1, u1, v1, {color[0], color[1], color[2], color[3]}, mode},
+    };
+    struct vertex *v = &out[*count];
+    v[0] = corners[0];
+    v[1] = corners[1];
+    v[2] = corners[2];
+    v[3] = corners[2];
+    v[4] = corners[1];
+    v[5] = corners[3];
+    *count += 6;
+}
+
+static bool rect_intersects(struct rect a, struct rect b) {
+    return a.x < b.x + b.width && b.x < a.x + a.width &&
+           a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static bool damage_intersects(const struct damage *damage, struct rect rect) {
+    for (int i = 0; i < damage->count; i++) {
+        if (rect_intersects(damage->rects[i], rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Clips a glyph quad to its block, cutting the texture coordinates to match. */
+static void add_clipped_quad(struct vertex *out, int *count, struct rect clip,
+                             float x0, float y0, float x1, float y1,
+                             float u0, float v0, float u1, float v1,
+                             const GLubyte color[4], enum quad_mode mode) {
+    float cx0 = x0 > clip.x ? x0 : clip.x;
+    float cy0 = y0 > clip.y ? y0 : clip.y;
+    float cx1 = x1 < clip.x + clip.width ? x1 : clip.x + clip.width;
+    float cy1 = y1 < clip.y + clip.height ? y1 : clip.y + clip.height;
+    if (cx0 >= cx1 || cy0 >= cy1) {
+        return;
+    }
+    float du = (u1 - u0) / (x1 - x0), dv = (v1 - v0) / (y1 - y0);
+    add_quad(out, count, cx0, cy0, cx1, cy1,
+             u0 + (cx0 - x0) * du, v0 + (cy0 - y0) * dv,
+             u0 + (cx1 - x0) * du, v0 + (cy1 - y0) * dv, color, mode);
+}
+
+static bool has_shape(const struct block_style *style) {
+    return style->radius > 0 || style->border_width > 0 ||
+           style->margin > 0 || style->shadow > 0;
+}
+
+/*
+ * Adds a rounded rectangle, or its shadow, clipped to the block's box. The
+ * quad reaches `spread` pixels beyond the rectangle, where a shadow fades.
+ */
+static void add_shape(struct rect clip, struct rect shape, float spread,
+                      const GLubyte color[4], const GLubyte border[4], float radius,
+                      float edge, enum quad_mode mode) {
+    float half_width = shape.width / 2.0f, half_height = shape.height / 2.0f;
+    float cx = shape.x + half_width, cy = shape.y + half_height;
+    float reach_x = half_width + spread, reach_y = half_height + spread;
+    int first = vertex_count;
+    add_clipped_quad(vertices, &vertex_count, clip,
+                     cx - reach_x, cy - reach_y, cx + reach_x, cy + reach_y,
+                     -reach_x, -reach_y, reach_x, reach_y, color, mode);
+
+    float max_radius = half_width < half_height ? half_width : half_height;
+    for (int i = first; i < vertex_count; i++) {
+        struct vertex *v = &vertices[i];
+        v->shape[0] = half_width;
+        v->shape[1] = half_height;
+        v->shape[2] = radius < max_radius ? radius : max_radius;
+        v->shape[3] = edge;
+        memcpy(v->border, border, sizeof(v->border));
+    }
+}
+
+/*
+ * The corners and margin show the bar's background, which the clear only
+ * restored inside the damage, so it is painted under the whole box first.
+ * That keeps every pixel of a drawn block independent of what was there.
+ */
+static void add_shaped_background(const struct scene *scene, struct rect box,
+                                  const GLubyte bg[4]) {
+    const struct block_style *style = &scene->style;
+    GLubyte background[4], border[4], shadow[4];
+    premultiply(scene->background, background);
+    premultiply(style->border_color, border);
+    premultiply(0x80000000, shadow);
+    add_quad(vertices, &vertex_count, box.x, box.y,
+             box.x + box.width, box.y + box.height, 0, 0, 0, 0, background, QUAD_SOLID);
+
+    struct rect shape = {
+        box.x + style->margin, box.y + style->margin,
+        box.width - 2 * style->margin, box.height - 2 * style->margin,
+    };
+    if (shape.width <= 0 || shape.height <= 0) {
+        return;
+    }
+    if (style->shadow > 0) {
+        struct rect offset = shape;
+        offset.y += style->shadow / 2;
+        add_shape(box, offset, style->shadow, shadow, shadow, style->radius,
+                  style->shadow, QUAD_SHADOW);
+    }
+    add_shape(box, shape, 0, bg, border, style->radius, style->border_width, QUAD_SHAPE);
+}
+
+/*
+ * Builds quads for every block touching the damage, in target coordinates.
+ * Returns false when the atlas ran out of space; nothing has been drawn yet
+ * at that point, so the caller can reset the atlas and build again.
+ */
+static bool build_quads(const struct scene *scene, struct rect area,
+                        const struct damage *damage) {
+    vertex_count = subpixel_vertex_count = 0;
+    int32_t baseline = scene_baseline(scene) - area.y;
+
+    for (int i = 0; i < scene->count; i++) {
+        const struct block *block = &scene->blocks[i];
+        struct rect box = {
+            block->box.x - area.x, block->box.y - area.y,
+            block->box.width, block->box.height,
+        };
+        if (!damage_intersects(damage, box)) {
+            continue;
+        }
+        GLubyte bg[4], fg[4];
+        premultiply(block->bg, bg);
+        premultiply(block->fg, fg);
+        if (has_shape(&scene->style)) {
+            add_shaped_background(scene, box, bg);
+        } else {
+            add_quad(vertices, &vertex_count, box.x, box.y,
+                     box.x + box.width, box.y + box.height, 0, 0, 0, 0, bg, QUAD_SOLID);
+        }
+
+        int32_t pen = box.x + scene->padding;
+        for (int j = 0; j < block->length; j++) {
+            const struct atlas_glyph *glyph =
+                atlas_get(scene->font, block->codepoints[j], FCFT_SUBPIXEL_DEFAULT);
+            if (glyph == NULL) {
+                return false;
+            }
+            if (glyph->width > 0) {
+                float x = pen + glyph->x, y = baseline - glyph->y;
+                bool subpixel = glyph->mode == GLYPH_SUBPIXEL;
+                struct vertex *out = subpixel ? subpixel_vertices : vertices;
+                int *count = subpixel ? &subpixel_vertex_count : &vertex_count;
+                int first = *count;
+                add_clipped_quad(out, count, box,
+                                 x, y, x + glyph->width, y + glyph->height,
+                                 glyph->u0, glyph->v0, glyph->u1, glyph->v1, fg,
+                                 glyph->mode == GLYPH_COLOR ? QUAD_COLOR :
+                                 subpixel ? QUAD_SUBPIXEL : QUAD_MASK);
+                for (int k = first; k < *count; k++) {
+                    out[k].page = glyph->page;
+                }
+            }
+            pen += glyph->advance;
+        }
+    }
+    return true;
+}
+
+static void bind_vertices(size_t offset) {
+    const struct vertex *v = (const struct vertex *)offset;
+    glVertexAttribPointer(ATTRIB_POS, 2, GL_FLOAT, GL_FALSE, sizeof(*v), &v->x);
+    glVertexAttribPointer(ATTRIB_UV, 2, GL_FLOAT, GL_FALSE, sizeof(*v), &v->u);
+    glVertexAttribPointer(ATTRIB_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(*v), v->color);
+    glVertexAttribPointer(ATTRIB_MODE, 1, GL_FLOAT, GL_FALSE, sizeof(*v), &v->mode);
+    glVertexAttribPointer(ATTRIB_PAGE, 1, GL_FLOAT, GL_FALSE, sizeof(*v), &v->page);
+    glVertexAttribPointer(ATTRIB_SHAPE, 4, GL_FLOAT, GL_FALSE, sizeof(*v), v->shape);
+    glVertexAttribPointer(ATTRIB_BORDER, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(*v), v->border);
+}
+
+static void upload_vertices(void) {
+    size_t size = vertex_count * sizeof(struct vertex);
+    size_t subpixel_size = subpixel_vertex_count * sizeof(struct vertex);
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+    glBufferData(GL_ARRAY_BUFFER, size + subpixel_size, NULL, GL_STREAM_DRAW);
+    if (size > 0) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices);
+    }
+    if (subpixel_size > 0) {
+        glBufferSubData(GL_ARRAY_BUFFER, size, subpixel_size, subpixel_vertices);
+    }
+}
+
+/*
+ * The damage is only cleared, under a scissor per rectangle. The quads are
+ * then drawn unclipped, whole blocks at a time: block backgrounds are
+ * opaque and glyphs are clipped to their block, so pixels outside the
+ * damage are rewritten with exactly what they already hold. That makes the
+ * draw call count independent of the number of damage rectangles: one,
+ * plus two more when there are subpixel glyphs.
+ */
+void render_scene(const struct scene *scene, struct rect area, const struct damage *damage) {
+    atlas_begin_frame();
+    if (!build_quads(scene, area, damage)) {
+        atlas_reset();
+        if (!build_quads(scene, area, damage)) {
+            fprintf(stderr, "Glyph atlas too small for the bar contents\n");
+        }
+    }
+
+    glViewport(0, 0, area.width, area.height);
+    GLfloat bg[4] = {
+        ((scene->background >> 16) & 0xff) / 255.0f,
+        ((scene->background >> 8) & 0xff) / 255.0f,
+        (scene->background & 0xff) / 255.0f,
+        (scene->background >> 24) / 255.0f,
+    };
+    glClearColor(bg[0] * bg[3], bg[1] * bg[3], bg[2] * bg[3], bg[3]);
+    glEnable(GL_SCISSOR_TEST);
+    for (int i = 0; i < damage->count; i++) {
+        const struct rect *r = &damage->rects[i];
+        /* GL's origin is bottom-left, surface coordinates are top-left. */
+        glScissor(r->x, area.height - r->y - r->height, r->width, r->height);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    glDisable(GL_SCISSOR_TEST);
+    if (vertex_count + subpixel_vertex_count == 0) {
+        return;
+    }
+
+    glUseProgram(program);
+    glUniform2f(u_scale, 2.0f / area.width, -2.0f / area.height);
+    static const GLint units[ATLAS_MAX_PAGES] = {0, 1, 2, 3};
+    glUniform1iv(u_atlas, ATLAS_MAX_PAGES, units);
+    for (int i = 0; i < ATLAS_MAX_PAGES; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, atlas_texture(i));
+    }
+    glActiveTexture(GL_TEXTURE0);
+    for (int i = ATTRIB_POS; i <= ATTRIB_BORDER; i++) {
+        glEnableVertexAttribArray(i);
+    }
+    upload_vertices();
+    glEnable(GL_BLEND);
+
+    if (vertex_count > 0) {
+        bind_vertices(0);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glUniform1f(u_pass, 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, vertex_count);
+    }
+    if (subpixel_vertex_count > 0) {
+        bind_vertices(vertex_count * sizeof(struct vertex));
+        glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+        glUniform1f(u_pass, 0.0f);
+        glDrawArrays(GL_TRIANGLES, 0, subpixel_vertex_count);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glUniform1f(u_pass, 1.0f);
+        glDrawArrays(GL_TRIANGLES, 0, subpixel_vertex_count);
+    }
+    glDisable(GL_BLEND);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,29 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "damage.h"
+#include "scene.h"
+
+/*
+ * The GL side of drawing the bar. Everything here only needs a current
+ * GLES2 context, so the same code runs against a Wayland EGLSurface in
+ * popup.c and against an offscreen target in bench.c.
+ */
+
+bool has_extension(const char *extensions, const char *name);
+
+/* Compiles the shaders and creates the glyph atlas in the current context. */
+void render_init(void);
+void render_finish(void);
+/* Drops cached glyphs that have not been drawn lately; for idle periods. */
+void render_trim(void);
+
+/*
+ * Repaints the given regions of a target showing the area of the scene;
+ * damage is relative to the area's top-left corner.
+ */
+void render_scene(const struct scene *scene, struct rect area, const struct damage *damage);
+
+#endif
@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "render_thread.h"
+#include "stats.h"
+
+/*
+ * Commands travel through a single-producer, single-consumer ring: the loop
+ * thread only advances head, the render thread only advances tail. The ring
+ * is far larger than the number of snapshots, so only a burst of target
+ * creation can fill it.
+ */
+#define QUEUE_SIZE 64
+#define MAX_SNAPSHOTS 4
+
+enum command_type {
+    COMMAND_CREATE,
+    COMMAND_RESIZE,
+    COMMAND_PRESENT,
+    COMMAND_DESTROY,
+    COMMAND_TRIM,
+    COMMAND_FINISH,
+};
+
+struct threaded_target {
+    struct render_target base;
+    /* Only ever touched by the render thread. */
+    struct render_target *inner;
+};
+
+/*
+ * The scene as it was when present() was called; only the blocks in use
+ * are copied. The loop thread owns a snapshot while it is not busy.
+ */
+struct snapshot {
+    atomic_bool busy;
+    struct rect area;
+    struct damage damage;
+    struct subsurface_position positions[SCENE_MAX_BLOCKS];
+    int position_count;
+    uint64_t queued;
+    struct scene scene;
+};
+
+struct command {
+    enum command_type type;
+    struct threaded_target *target;
+    int32_t width, height;
+    struct snapshot *snapshot;
+};
+
+static const struct backend *inner;
+static pthread_t thread;
+static bool started;
+
+static struct command queue[QUEUE_SIZE];
+static atomic_uint head, tail;
+static struct snapshot snapshots[MAX_SNAPSHOTS];
+static struct snapshot *acquired;
+
+/* wake_fd wakes the render thread, done_fd the loop thread. */
+static int wake_fd = -1, done_fd = -1;
+/* Set by the loop thread while it waits for a snapshot to free up. */
+static atomic_bool starved;
+
+static void signal_fd(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static void push(struct command command) {
+    unsigned int h = atomic_load_explicit(&head, memory_order_relaxed);
+    /* Only reachable with dozens of targets created at once. */
+    while (h - atomic_load_explicit(&tail, memory_order_acquire) == QUEUE_SIZE) {
+        sched_yield();
+    }
+    queue[h % QUEUE_SIZE] = command;
+    atomic_store_explicit(&head, h + 1, memory_order_release);
+    signal_fd(wake_fd);
+}
+
+static void release_snapshot(struct snapshot *snapshot) {
+    atomic_store(&snapshot->busy, false);
+    if (atomic_exchange(&starved, false)) {
+        signal_fd(done_fd);
+    }
+}
+
+static bool execute(const struct command *command) {
+    struct threaded_target *target = command->target;
+    switch (command->type) {
+    case COMMAND_CREATE:
+        target->inner = inner->create_target(target->base.surface,
+                                             command->width, command->height);
+        break;
+    case COMMAND_RESIZE:
+        inner->resize_target(target->inner, command->width, command->height);
+        break;
+    case COMMAND_PRESENT: {
+        struct snapshot *snapshot = command->snapshot;
+        stats_record(STATS_RENDER_QUEUE, snapshot->queued);
+        target->inner->x = snapshot->area.x;
+        target->inner->y = snapshot->area.y;
+        memcpy(target->inner->positions, snapshot->positions,
+               snapshot->position_count * sizeof(snapshot->positions[0]));
+        target->inner->position_count = snapshot->position_count;
+        inner->present(target->inner, &snapshot->scene, &snapshot->damage);
+        release_snapshot(snapshot);
+        break;
+    }
+    case COMMAND_DESTROY:
+        target->inner->subsurface = target->base.subsurface;
+        target->inner->viewport = target->base.viewport;
+        inner->destroy_target(target->inner);
+        free(target);
+        break;
+    case COMMAND_TRIM:
+        inner->trim();
+        break;
+    case COMMAND_FINISH:
+        /* The context is current on this thread, so it is released here. */
+        inner->finish();
+        return false;
+    }
+    return true;
+}
+
+static void *render_loop(void *data) {
+    for (;;) {
+        unsigned int t = atomic_load_explicit(&tail, memory_order_relaxed);
+        if (t == atomic_load_explicit(&head, memory_order_acquire)) {
+            /* The eventfd counts, so a push after the check is not lost. */
+            uint64_t count;
+            if (read(wake_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+                perror("render thread");
+                exit(1);
+            }
+            continue;
+        }
+        struct command command = queue[t % QUEUE_SIZE];
+        atomic_store_explicit(&tail, t + 1, memory_order_release);
+        if (!execute(&command)) {
+            return NULL;
+        }
+    }
+}
+
+static void init_threaded(struct wl_display *display, struct wl_shm *shm) {
+    inner->init(display, shm);
+    /*
+     * The thread inherits the caller's mask; with every signal blocked it
+     * never takes one meant for the loop thread's signalfd.
+     */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int err = pthread_create(&thread, NULL, render_loop, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err != 0) {
+        fprintf(stderr, "Failed to start render thread: %s\n", strerror(err));
+        exit(1);
+    }
+    started = true;
+}
+
+static struct render_target *create_threaded_target(struct wl_surface *surface,
+                                                    int32_t width, int32_t height) {
+    struct threaded_target *target = calloc(1, sizeof(*target));
+    if (target == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    target->base.surface = surface;
+    target->base.width = width;
+    target->base.height = height;
+    push((struct command){COMMAND_CREATE, target, width, height, NULL});
+    return &target->base;
+}
+
+static void resize_threaded_target(struct render_target *base, int32_t width, int32_t height) {
+    base->width = width;
+    base->height = height;
+    push((struct command){COMMAND_RESIZE, (struct threaded_target *)base, width, height, NULL});
+}
+
+static struct snapshot *find_free_snapshot(void) {
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (!atomic_load(&snapshots[i].busy)) {
+            return &snapshots[i];
+        }
+    }
+    return NULL;
+}
+
+static bool acquire_threaded(struct render_target *base) {
+    if (acquired == NULL) {
+        acquired = find_free_snapshot();
+    }
+    if (acquired == NULL) {
+        /*
+         * Announce the wait, then look again: a snapshot released in
+         * between either shows up here or signals done_fd.
+         */
+        atomic_store(&starved, true);
+        acquired = find_free_snapshot();
+        if (acquired) {
+            atomic_store(&starved, false);
+        }
+    }
+    return acquired != NULL;
+}
+
+static void present_threaded(struct render_target *base, const struct scene *scene,
+                             const struct damage *damage) {
+    struct snapshot *snapshot = acquired;
+    acquired = NULL;
+    snapshot->area = (struct rect){base->x, base->y, base->width, base->height};
+    snapshot->damage = *damage;
+    memcpy(snapshot->positions, base->positions, base->position_count * sizeof(base->positions[0]));
+    snapshot->position_count = base->position_count;
+    base->position_count = 0;
+    memcpy(&snapshot->scene, scene,
+           offsetof(struct scene, blocks) + scene->count * sizeof(scene->blocks[0]));
+    snapshot->queued = stats_now();
+    atomic_store(&snapshot->busy, true);
+    push((struct command){COMMAND_PRESENT, (struct threaded_target *)base, 0, 0, snapshot});
+}
+
+/*
+ * The render thread destroys the target, and the wl_surface with it, after
+ * whatever it still has queued for it, so the loop thread never waits
+ * behind a swap that may block until the output shows a frame again.
+ */
+static void destroy_threaded_target(struct render_target *base) {
+    push((struct command){COMMAND_DESTROY, (struct threaded_target *)base, 0, 0, NULL});
+}
+
+static void finish_threaded(void) {
+    if (started) {
+        push((struct command){COMMAND_FINISH, NULL, 0, 0, NULL});
+        pthread_join(thread, NULL);
+        started = false;
+    } else {
+        inner->finish();
+    }
+    close(wake_fd);
+    close(done_fd);
+    wake_fd = done_fd = -1;
+}
+
+static void trim_threaded(void) {
+    if (inner->trim) {
+        push((struct command){COMMAND_TRIM, NULL, 0, 0, NULL});
+    }
+}
+
+static void set_threaded_swap_interval(int interval) {
+    if (inner->set_swap_interval) {
+        inner->set_swap_interval(interval);
+    }
+}
+
+static const struct backend threaded_backend = {
+    .name = "threaded",
+    .init = init_threaded,
+    .create_target = create_threaded_target,
+    .resize_target = resize_threaded_target,
+    .acquire = acquire_threaded,
+    .present = present_threaded,
+    .destroy_target = destroy_threaded_target,
+    .finish = finish_threaded,
+    .set_swap_interval = set_threaded_swap_interval,
+    .trim = trim_threaded,
+};
+
+const struct backend *render_thread_wrap(const struct backend *backend) {
+    inner = backend;
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd < 0 || done_fd < 0) {
+        perror("render thread");
+        exit(1);
+    }
+    return &threaded_backend;
+}
+
+int render_thread_get_fd(void) {
+    return done_fd;
+}
+
+void render_thread_clear(void) {
+    uint64_t count;
+    while (read(done_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+}
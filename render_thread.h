@@ -0,0 +1,22 @@
+#ifndef RENDER_THREAD_H
+#define RENDER_THREAD_H
+
+#include "backend.h"
+
+/*
+ * Runs another backend on a dedicated render thread that owns its context
+ * and does all of its drawing and swapping. The returned backend is used
+ * from the loop thread as usual: present() copies the scene into a snapshot
+ * and queues it, so a swap blocked on vsync never holds up dispatch.
+ *
+ * acquire() fails while every snapshot is still queued or being drawn;
+ * the fd from render_thread_get_fd() becomes readable when one frees up.
+ * Only backends whose targets are not touched by the loop thread's event
+ * dispatch can be wrapped, which rules out shm.
+ */
+const struct backend *render_thread_wrap(const struct backend *inner);
+int render_thread_get_fd(void);
+/* Consumes the wakeup; call when the fd is readable. */
+void render_thread_clear(void);
+
+#endif
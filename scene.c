@@ -0,0 +1,151 @@
+#include <string.h>
+#include <fcft/fcft.h>
+#include "scene.h"
+
+static int decode_utf8(const char *s, uint32_t *out, int max) {
+    const unsigned char *p = (const unsigned char *)s;
+    int count = 0;
+    while (*p && count < max) {
+        uint32_t cp;
+        int extra;
+        if (*p < 0x80) {
+            cp = *p;
+            extra = 0;
+        } else if ((*p & 0xe0) == 0xc0) {
+            cp = *p & 0x1f;
+            extra = 1;
+        } else if ((*p & 0xf0) == 0xe0) {
+            cp = *p & 0x0f;
+            extra = 2;
+        } else if ((*p & 0xf8) == 0xf0) {
+            cp = *p & 0x07;
+            extra = 3;
+        } else {
+            out[count++] = 0xfffd;
+            p++;
+            continue;
+        }
+        p++;
+        for (; extra > 0; extra--, p++) {
+            if ((*p & 0xc0) != 0x80) {
+                cp = 0xfffd;
+                break;
+            }
+            cp = (cp << 6) | (*p & 0x3f);
+        }
+        out[count++] = cp;
+    }
+    return count;
+}
+
+static int32_t measure(struct fcft_font *font, const uint32_t *codepoints, int length) {
+    int32_t width = 0;
+    for (int i = 0; i < length; i++) {
+        const struct fcft_glyph *glyph =
+            fcft_rasterize_char_utf32(font, codepoints[i], FCFT_SUBPIXEL_DEFAULT);
+        if (glyph) {
+            width += glyph->advance.x;
+        }
+    }
+    return width;
+}
+
+static void layout(struct scene *scene) {
+    int32_t x = scene->width;
+    for (int i = scene->count - 1; i >= 0; i--) {
+        struct block *block = &scene->blocks[i];
+        int32_t width = block->text_width + 2 * scene->padding;
+        x -= width;
+        block->box = (struct rect){x, 0, width, scene->height};
+    }
+}
+
+void scene_init(struct scene *scene, struct fcft_font *font) {
+    memset(scene, 0, sizeof(*scene));
+    scene->font = font;
+    scene->padding = BLOCK_PADDING;
+    scene->background = 0xff222222;
+}
+
+void scene_set_font(struct scene *scene, struct fcft_font *font, int32_t padding) {
+    if (font == scene->font && padding == scene->padding) {
+        return;
+    }
+    scene->font = font;
+    scene->padding = padding;
+    for (int i = 0; i < scene->count; i++) {
+        struct block *block = &scene->blocks[i];
+        block->text_width = measure(font, block->codepoints, block->length);
+    }
+    layout(scene);
+}
+
+void scene_set_style(struct scene *scene, const struct block_style *style) {
+    scene->style = *style;
+}
+
+void scene_resize(struct scene *scene, int32_t width, int32_t height) {
+    scene->width = width;
+    scene->height = height;
+    layout(scene);
+}
+
+static bool rect_equal(struct rect a, struct rect b) {
+    return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+void scene_set_status(struct scene *scene, const char *status, struct damage *damage) {
+    struct rect old_boxes[SCENE_MAX_BLOCKS];
+    bool changed[SCENE_MAX_BLOCKS] = {false};
+    int old_count = scene->count;
+    for (int i = 0; i < old_count; i++) {
+        old_boxes[i] = scene->blocks[i].box;
+    }
+
+    int count = 0;
+    const char *p = status;
+    while (count < SCENE_MAX_BLOCKS) {
+        size_t len = strcspn(p, "\t");
+        if (len >= BLOCK_TEXT_MAX) {
+            len = BLOCK_TEXT_MAX - 1;
+        }
+        struct block *block = &scene->blocks[count];
+        if (count >= old_count || strncmp(block->text, p, len) != 0 || block->text[len] != '\0') {
+            memcpy(block->text, p, len);
+            block->text[len] = '\0';
+            block->length = decode_utf8(block->text, block->codepoints, BLOCK_TEXT_MAX);
+            block->text_width = measure(scene->font, block->codepoints, block->length);
+            block->fg = 0xffdddddd;
+            block->bg = 0xff333333;
+            changed[count] = true;
+        }
+        count++;
+        p += strcspn(p, "\t");
+        if (*p != '\t') {
+            break;
+        }
+        p++;
+    }
+
+    scene->count = count;
+    layout(scene);
+
+    for (int i = 0; i < count; i++) {
+        struct block *block = &scene->blocks[i];
+        bool moved = i < old_count && !rect_equal(old_boxes[i], block->box);
+        if (changed[i] || moved) {
+            if (i < old_count) {
+                damage_add(damage, old_boxes[i]);
+            }
+            damage_add(damage, block->box);
+        }
+    }
+    for (int i = count; i < old_count; i++) {
+        damage_add(damage, old_boxes[i]);
+    }
+}
+
+int32_t scene_baseline(const struct scene *scene) {
+    const struct fcft_font *font = scene->font;
+    return (scene->height - font->height) / 2 + font->ascent;
+}
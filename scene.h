@@ -0,0 +1,69 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <stdint.h>
+#include "damage.h"
+
+struct fcft_font;
+
+#define SCENE_MAX_BLOCKS 32
+#define BLOCK_TEXT_MAX 256
+#define BLOCK_PADDING 8
+
+/*
+ * What the bar shows, independent of how it is drawn. Blocks are laid out
+ * right to left from the right edge, so the last block sits in the corner.
+ * Text is decoded to codepoints once, when it changes, not on every frame.
+ * Colours are 0xAARRGGBB, not premultiplied.
+ */
+struct block {
+    char text[BLOCK_TEXT_MAX];
+    uint32_t codepoints[BLOCK_TEXT_MAX];
+    int length;
+    int32_t text_width;
+    uint32_t fg, bg;
+    struct rect box;
+};
+
+/*
+ * How block backgrounds are drawn, in buffer pixels. The shape is the
+ * block's box inset by margin, with rounded corners and an optional border
+ * inside its edge; a shadow of the given size spreads from it into the
+ * margin. All zero is a plain rectangle filling the box.
+ */
+struct block_style {
+    int32_t radius;
+    int32_t border_width;
+    uint32_t border_color;
+    int32_t margin;
+    int32_t shadow;
+};
+
+/*
+ * Geometry is in buffer pixels. A scene drawn at another scale gets a font
+ * rasterized for that scale and proportionally larger padding.
+ */
+struct scene {
+    struct fcft_font *font;
+    int32_t padding;
+    int32_t width, height;
+    uint32_t background;
+    struct block_style style;
+    int count;
+    struct block blocks[SCENE_MAX_BLOCKS];
+};
+
+void scene_init(struct scene *scene, struct fcft_font *font);
+void scene_resize(struct scene *scene, int32_t width, int32_t height);
+/* Switches to another font and padding; the whole scene must be redrawn. */
+void scene_set_font(struct scene *scene, struct fcft_font *font, int32_t padding);
+/* Also needs a full redraw when it changes anything. */
+void scene_set_style(struct scene *scene, const struct block_style *style);
+/*
+ * Replaces the status text; blocks are separated by tabs. Adds the regions
+ * whose pixels change to damage.
+ */
+void scene_set_status(struct scene *scene, const char *status, struct damage *damage);
+int32_t scene_baseline(const struct scene *scene);
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdbool.h>
+#include <time.h>
+#include "stats.h"
+
+static const char *const phase_names[STATS_PHASE_COUNT] = {
+    [STATS_DISPATCH] = "dispatch",
+    [STATS_DRAW] = "draw",
+    [STATS_SWAP] = "swap",
+    [STATS_CALLBACK_TO_PRESENT] = "callback_to_present",
+    [STATS_PRESENT_LATENCY] = "present_latency",
+    [STATS_PRESENT_INTERVAL] = "present_interval",
+    [STATS_RENDER_QUEUE] = "render_queue",
+    [STATS_MODULE_UPDATE] = "module_update",
+};
+
+static const char *const counter_names[STATS_COUNTER_COUNT] = {
+    [STATS_FRAMES_DRAWN] = "frames_drawn",
+    [STATS_FRAMES_SKIPPED] = "frames_skipped",
+    [STATS_FRAMES_PRESENTED] = "frames_presented",
+    [STATS_FRAMES_DISCARDED] = "frames_discarded",
+    [STATS_FRAMES_VSYNC] = "frames_vsync",
+    [STATS_FRAMES_ZERO_COPY] = "frames_zero_copy",
+    [STATS_FRAMES_THROTTLED] = "frames_throttled",
+};
+
+static const char *const milestone_names[STATS_MILESTONE_COUNT] = {
+    [STATS_FONT_LOADED] = "font_loaded",
+    [STATS_BACKEND_READY] = "backend_ready",
+    [STATS_CONFIGURED] = "configured",
+    [STATS_FIRST_COMMIT] = "first_commit",
+    [STATS_FIRST_FRAME] = "time_to_first_frame",
+};
+
+static struct histogram phases[STATS_PHASE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+static uint64_t start_time;
+static uint64_t milestones[STATS_MILESTONE_COUNT];
+
+/*
+ * Each histogram and counter has one writer at a time, which may be the
+ * render thread, while stats_dump() runs on the loop thread. Values are
+ * stored and loaded as relaxed atomics: a dump reads every one whole,
+ * though not all from the same instant, and writers pay no locked
+ * instructions.
+ */
+static void add(uint64_t *value, uint64_t n) {
+    __atomic_store_n(value, *value + n, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(const uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void histogram_add(struct histogram *histogram, uint64_t ns) {
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    if (bucket >= STATS_BUCKETS) {
+        bucket = STATS_BUCKETS - 1;
+    }
+    add(&histogram->buckets[bucket], 1);
+    add(&histogram->count, 1);
+    add(&histogram->sum_ns, ns);
+    if (ns > histogram->max_ns) {
+        __atomic_store_n(&histogram->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+uint64_t histogram_percentile(const struct histogram *histogram, int percent) {
+    uint64_t rank = (load(&histogram->count) * percent + 99) / 100;
+    uint64_t max_ns = load(&histogram->max_ns);
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += load(&histogram->buckets[i]);
+        if (seen >= rank && seen > 0) {
+            uint64_t bound = i ? (uint64_t)1 << i : 1;
+            return bound < max_ns ? bound : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+void stats_record_ns(enum stats_phase phase, uint64_t ns) {
+    histogram_add(&phases[phase], ns);
+}
+
+void stats_record(enum stats_phase phase, uint64_t start) {
+    stats_record_ns(phase, stats_now() - start);
+}
+
+void stats_count(enum stats_counter counter) {
+    add(&counters[counter], 1);
+}
+
+void stats_start(void) {
+    start_time = stats_now();
+}
+
+void stats_milestone(enum stats_milestone milestone) {
+    uint64_t unset = 0;
+    uint64_t elapsed = stats_now() - start_time;
+    __atomic_compare_exchange_n(&milestones[milestone], &unset, elapsed ? elapsed : 1,
+                                false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+void stats_dump(FILE *out) {
+    for (int i = 0; i < STATS_MILESTONE_COUNT; i++) {
+        uint64_t ns = __atomic_load_n(&milestones[i], __ATOMIC_RELAXED);
+        if (ns) {
+            fprintf(out, "%s_us %.1f\n", milestone_names[i], ns / 1e3);
+        }
+    }
+    for (int i = 0; i < STATS_COUNTER_COUNT; i++) {
+        fprintf(out, "%s %llu\n", counter_names[i], (unsigned long long)load(&counters[i]));
+    }
+    for (int i = 0; i < STATS_PHASE_COUNT; i++) {
+        const struct histogram *h = &phases[i];
+        uint64_t count = load(&h->count);
+        fprintf(out, "%s count=%llu mean_us=%.1f p50_us=%.1f p99_us=%.1f max_us=%.1f\n",
+                phase_names[i], (unsigned long long)count,
+                count ? load(&h->sum_ns) / 1e3 / count : 0.0,
+                histogram_percentile(h, 50) / 1e3, histogram_percentile(h, 99) / 1e3,
+                load(&h->max_ns) / 1e3);
+    }
+}
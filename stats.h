@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Always-on counters for the hot path. Durations go into fixed log2
+ * histograms (bucket i holds values in [2^(i-1), 2^i) ns), so recording is
+ * a clock read and a few increments, and nothing is ever allocated.
+ */
+#define STATS_BUCKETS 40
+
+enum stats_phase {
+    STATS_DISPATCH,
+    STATS_DRAW,
+    STATS_SWAP,
+    STATS_CALLBACK_TO_PRESENT,
+    /* Commit to the wp_presentation timestamp: when it turned into light. */
+    STATS_PRESENT_LATENCY,
+    /* Between successive presentations of one surface. */
+    STATS_PRESENT_INTERVAL,
+    /* From present() to the render thread picking the snapshot up. */
+    STATS_RENDER_QUEUE,
+    /* One update() of one module, whether its text changed or not. */
+    STATS_MODULE_UPDATE,
+    STATS_PHASE_COUNT,
+};
+
+enum stats_counter {
+    STATS_FRAMES_DRAWN,
+    STATS_FRAMES_SKIPPED,
+    STATS_FRAMES_PRESENTED,
+    STATS_FRAMES_DISCARDED,
+    STATS_FRAMES_VSYNC,
+    STATS_FRAMES_ZERO_COPY,
+    /* Dirty frames held back because too many were in flight. */
+    STATS_FRAMES_THROTTLED,
+    STATS_COUNTER_COUNT,
+};
+
+/*
+ * One-shot startup milestones, in ns since stats_start(). Only the first
+ * call for each milestone counts, and it may come from any thread.
+ */
+enum stats_milestone {
+    STATS_FONT_LOADED,
+    STATS_BACKEND_READY,
+    STATS_CONFIGURED,
+    STATS_FIRST_COMMIT,
+    STATS_FIRST_FRAME,
+    STATS_MILESTONE_COUNT,
+};
+
+struct histogram {
+    uint64_t buckets[STATS_BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+};
+
+uint64_t stats_now(void);
+void stats_record_ns(enum stats_phase phase, uint64_t ns);
+/* Records the time elapsed since start, a value from stats_now(). */
+void stats_record(enum stats_phase phase, uint64_t start);
+void stats_count(enum stats_counter counter);
+void stats_start(void);
+void stats_milestone(enum stats_milestone milestone);
+
+void histogram_add(struct histogram *histogram, uint64_t ns);
+/* Upper bound of the bucket holding the given percentile, in ns. */
+uint64_t histogram_percentile(const struct histogram *histogram, int percent);
+
+void stats_dump(FILE *out);
+
+#endif